@@ -0,0 +1,307 @@
+#include "builtin-datasets.h" // for builtin_datasets
+#include "dataset.h"          // for DataSet, dataset_from_compressed_blocks, dataset_element
+#include "diff.h"             // for diff_edit_script_with_engine, DiffEngine
+#include "rng.h"              // for Rng, rng_from_seed, rng_below
+#include "timespan.h"         // for TimeSpanSec, now
+
+#include <ctype.h>  // for islower, isupper, tolower, toupper
+#include <stdint.h> // for uint16_t
+#include <stdio.h>  // for printf
+#include <stdlib.h> // for malloc, free
+#include <string.h> // for memcpy, memmove
+
+// every measurement repeats the diff until this much time has passed
+#define BENCH_MIN_TIME 0.05
+#define BENCH_MAX_LEN  4096
+
+static const size_t line_lens[] = { 128, 512, 1024, 4096 };
+
+// dataset lines are benched in buckets of [bucket_lens[i], bucket_lens[i + 1]) bytes
+static const size_t bucket_lens[] = { 4, 16, 32, 64, 128, 192, 256, 384, 512, BENCH_MAX_LEN };
+#define BUCKET_LINES_COUNT 64
+
+typedef struct Timing {
+    double us;     // per diff
+    size_t edits;  // deleted + inserted, the same for every engine
+} Timing;
+
+// Diffs every a[i] against b[i], `us` is then the time for all of them
+static Timing time_engine(const StringView* a, const StringView* b, size_t count, DiffEngine engine) {
+    Timing timing = {0};
+    size_t runs = 0;
+    TimeSpanSec start = now(), elapsed;
+    do {
+        timing.edits = 0;
+        for (size_t i = 0; i < count; ++i) {
+            DiffEditScript script = diff_edit_script_with_engine(a[i], b[i], engine);
+            if (diff_edit_script_is_null(&script)) {
+                printf("diff failed\n");
+                exit(1);
+            }
+            timing.edits += script.deleted_count + script.inserted_count;
+            free_diff_edit_script(&script);
+        }
+        runs++;
+    } while ((elapsed = now() - start) < BENCH_MIN_TIME);
+
+    timing.us = elapsed / (double) runs * 1e6;
+    return timing;
+}
+
+// The O(n * m) LCS table print_diff filled before Myers, only the fill since that is all of its cost
+static Timing time_dp(StringView a, StringView b, uint16_t* table) {
+    Timing timing = {0};
+    size_t runs = 0;
+    size_t width = b.len + 1;
+    TimeSpanSec start = now(), elapsed;
+    do {
+        for (size_t j = 0; j <= b.len; ++j) table[j] = 0;
+        for (size_t i = 1; i <= a.len; ++i) {
+            uint16_t* row = table + i * width;
+            const uint16_t* above = row - width;
+            row[0] = 0;
+            for (size_t j = 1; j <= b.len; ++j) {
+                row[j] = a.data[i - 1] == b.data[j - 1]
+                    ? above[j - 1] + 1
+                    : (above[j] > row[j - 1] ? above[j] : row[j - 1]);
+            }
+        }
+        timing.edits = a.len + b.len - 2 * (size_t) table[a.len * width + b.len];
+        runs++;
+    } while ((elapsed = now() - start) < BENCH_MIN_TIME);
+
+    timing.us = elapsed / (double) runs * 1e6;
+    return timing;
+}
+
+// src/diff.c hands over once the middle snake of the top box, about half the edits, passes
+// DIFF_BIT_PARALLEL_WORD_COST * (n + 1) * words / (n + m) + DIFF_BIT_PARALLEL_SLACK,
+// so every measured crossing is a point (x, y) = ((n + 1) * words / (n + m), edits / 2) of that line
+#define MAX_CROSSINGS 64
+
+typedef struct Crossings {
+    double x[MAX_CROSSINGS], y[MAX_CROSSINGS];
+    size_t count;
+} Crossings;
+
+static void add_crossing(Crossings* crossings, double edits, size_t len) {
+    if (crossings->count == MAX_CROSSINGS) return;
+
+    size_t words = (len + 63) / 64;
+    crossings->x[crossings->count] = (double) ((len + 1) * words) / (double) (2 * len);
+    crossings->y[crossings->count] = edits / 2;
+    crossings->count++;
+}
+
+// Least squares line through the crossings, the word cost is its slope and the slack where it starts
+static void print_fit(const Crossings* crossings, const char* what) {
+    double n = (double) crossings->count, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (size_t i = 0; i < crossings->count; ++i) {
+        sx += crossings->x[i];
+        sy += crossings->y[i];
+        sxx += crossings->x[i] * crossings->x[i];
+        sxy += crossings->x[i] * crossings->y[i];
+    }
+    double denominator = n * sxx - sx * sx;
+    if (crossings->count < 2 || denominator <= 0) return;
+
+    double cost = (n * sxy - sx * sy) / denominator;
+    printf("Fitted on %s: DIFF_BIT_PARALLEL_WORD_COST %.1f, DIFF_BIT_PARALLEL_SLACK %.1f\n", what, cost, (sy - cost * sx) / n);
+}
+
+// QWERTY neighbours of every lowercase letter, the keys a slipping finger lands on
+static const char* const key_neighbours[26] = {
+    "qwsz", "vghn", "xdfv", "serfcx", "wsdr", "drtgvc", "ftyhbv", "gyujnb", "ujko", "huikmn", "jiolm", "kop",
+    "njk", "bhjm", "iklp", "ol", "wa", "edft", "awedxz", "rfgy", "yhji", "cfgb", "qase", "zsdc", "tghu", "asx",
+};
+
+// One typo as people make them: a neighbouring key, a dropped or doubled key, or two keys swapped
+static void add_typo(char* line, size_t* len, Rng* rng) {
+    if (*len < 2) return;
+
+    size_t i = rng_below(rng, *len - 1);
+    switch (rng_below(rng, 4)) {
+    case 0: {
+        unsigned char c = (unsigned char) line[i];
+        if (isalpha(c)) {
+            const char* neighbours = key_neighbours[tolower(c) - 'a'];
+            char typo = neighbours[rng_below(rng, strlen(neighbours))];
+            line[i] = isupper(c) ? (char) toupper(typo) : typo;
+        } else {
+            line[i] = c == '~' ? '}' : (char) (c + 1);
+        }
+    } break;
+    case 1:
+        memmove(line + i, line + i + 1, *len - i - 1);
+        (*len)--;
+        break;
+    case 2:
+        memmove(line + i + 1, line + i, *len - i);
+        (*len)++;
+        break;
+    default: {
+        char c = line[i];
+        line[i] = line[i + 1];
+        line[i + 1] = c;
+    } break;
+    }
+}
+
+// Lines typed with k typos each, k doubling until Myers falls behind the bit-parallel kernel
+static void bench_dataset_bucket(const StringView* lines, size_t count, char* typed_buf, StringView* typed, Rng* rng, Crossings* crossings) {
+    size_t total_len = 0, longest = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total_len += lines[i].len;
+        if (lines[i].len > longest) longest = lines[i].len;
+    }
+    size_t mean_len = (total_len + count / 2) / count;
+
+    // the last k Myers was still ahead at, a tie on the first few typos is timing noise
+    double crossing_edits = 0;
+    Timing ahead_myers = {0}, ahead_bit = {0};
+    for (size_t k = 1; k <= longest && crossing_edits == 0; k *= 2) {
+        for (size_t i = 0; i < count; ++i) {
+            // doubled keys can at most double a line
+            char* buf = typed_buf + i * 2 * BENCH_MAX_LEN;
+            size_t len = lines[i].len;
+            memcpy(buf, lines[i].data, len);
+            for (size_t t = 0; t < k && len < 2 * BENCH_MAX_LEN - 1; ++t) add_typo(buf, &len, rng);
+            typed[i] = sv_from_data_and_len(buf, len);
+        }
+
+        Timing myers = time_engine(lines, typed, count, DIFF_ENGINE_MYERS);
+        Timing bit = time_engine(lines, typed, count, DIFF_ENGINE_BIT_PARALLEL);
+        Timing automatic = time_engine(lines, typed, count, DIFF_ENGINE_AUTO);
+        if (myers.edits != bit.edits || myers.edits != automatic.edits) {
+            printf("engines disagree on the edit distance: %zu, %zu, %zu\n", myers.edits, bit.edits, automatic.edits);
+            exit(1);
+        }
+        double edits = (double) myers.edits / (double) count;
+        printf("    %8zu %6zu %8.1f %12.2f %12.2f %12.2f\n", mean_len, k, edits,
+               myers.us / (double) count, bit.us / (double) count, automatic.us / (double) count);
+
+        if (myers.us <= bit.us) {
+            ahead_myers = myers;
+            ahead_bit = bit;
+        } else if (ahead_myers.us > 0) {
+            double ahead_edits = (double) ahead_myers.edits / (double) count;
+            double before = ahead_bit.us - ahead_myers.us, after = myers.us - bit.us;
+            crossing_edits = ahead_edits + (edits - ahead_edits) * before / (before + after);
+        }
+    }
+
+    if (crossing_edits == 0) {
+        printf("    Myers %s for lines of about %zu bytes\n", ahead_myers.us > 0 ? "stays ahead" : "is never ahead", mean_len);
+        return;
+    }
+    add_crossing(crossings, crossing_edits, mean_len);
+    printf("    Myers gets slower past about %.1f edits\n", crossing_edits);
+}
+
+// Samples up to BUCKET_LINES_COUNT lines of every length bucket of every built-in dataset and benches each
+// bucket, lines are copied out since compressed elements only live in the block cache
+static void bench_builtin_datasets(Rng* rng, Crossings* crossings) {
+    size_t buckets_count = sizeof bucket_lens / sizeof bucket_lens[0] - 1;
+    char* lines_buf = malloc(BUCKET_LINES_COUNT * BENCH_MAX_LEN);
+    char* typed_buf = malloc(BUCKET_LINES_COUNT * 2 * BENCH_MAX_LEN);
+    if (lines_buf == NULL || typed_buf == NULL) exit(1);
+
+    for (size_t d = 0; d < builtin_datasets_count; ++d) {
+        DataSet dataset = dataset_from_compressed_blocks(builtin_datasets[d].blocks);
+        if (dataset_is_null(&dataset)) continue;
+
+        StringView name = builtin_datasets[d].name;
+        printf("Character diffs of @%.*s lines, each typed with k typos\n", (int) name.len, name.data);
+        printf("    %8s %6s %8s %12s %12s %12s\n", "mean len", "k", "edits", "Myers us", "bit-par us", "auto us");
+
+        for (size_t bucket = 0; bucket < buckets_count; ++bucket) {
+            // reservoir sampling, every line of the bucket is as likely to be picked
+            size_t picked[BUCKET_LINES_COUNT];
+            size_t seen = 0;
+            for (size_t i = 0; i < dataset.elements_count; ++i) {
+                size_t len = dataset_element(&dataset, i).len;
+                if (len < bucket_lens[bucket] || len >= bucket_lens[bucket + 1]) continue;
+
+                size_t slot = seen < BUCKET_LINES_COUNT ? seen : rng_below(rng, seen + 1);
+                if (slot < BUCKET_LINES_COUNT) picked[slot] = i;
+                seen++;
+            }
+            size_t count = seen < BUCKET_LINES_COUNT ? seen : BUCKET_LINES_COUNT;
+            if (count == 0) continue;
+
+            StringView lines[BUCKET_LINES_COUNT], typed[BUCKET_LINES_COUNT];
+            for (size_t i = 0; i < count; ++i) {
+                StringView element = dataset_element(&dataset, picked[i]);
+                memcpy(lines_buf + i * BENCH_MAX_LEN, element.data, element.len);
+                lines[i] = sv_from_data_and_len(lines_buf + i * BENCH_MAX_LEN, element.len);
+            }
+
+            bench_dataset_bucket(lines, count, typed_buf, typed, rng, crossings);
+        }
+        free_dataset(&dataset);
+    }
+
+    free(typed_buf);
+    free(lines_buf);
+}
+
+int main(void) {
+    char* a = malloc(BENCH_MAX_LEN);
+    char* b = malloc(BENCH_MAX_LEN);
+    uint16_t* table = malloc((BENCH_MAX_LEN + 1) * (BENCH_MAX_LEN + 1) * sizeof(uint16_t));
+    if (a == NULL || b == NULL || table == NULL) return 1;
+
+    Rng rng = rng_from_seed(1);
+    Crossings random_crossings = {0};
+
+    printf("Character diffs of random lowercase lines, b is a with k random substitutions\n");
+    printf("    %6s %6s %6s %12s %12s %12s %12s\n", "len", "k", "edits", "Myers us", "bit-par us", "auto us", "old DP us");
+
+    for (size_t l = 0; l < sizeof line_lens / sizeof line_lens[0]; ++l) {
+        size_t len = line_lens[l];
+        for (size_t i = 0; i < len; ++i) a[i] = (char) ('a' + rng_below(&rng, 26));
+
+        double crossing_edits = 0;
+        Timing prev_myers = {0}, prev_bit = {0};
+        for (size_t k = 1; k <= len; k *= 2) {
+            for (size_t i = 0; i < len; ++i) b[i] = a[i];
+            for (size_t i = 0; i < k; ++i) b[rng_below(&rng, len)] = (char) ('a' + rng_below(&rng, 26));
+
+            StringView as = sv_from_data_and_len(a, len), bs = sv_from_data_and_len(b, len);
+            Timing myers = time_engine(&as, &bs, 1, DIFF_ENGINE_MYERS);
+            Timing bit = time_engine(&as, &bs, 1, DIFF_ENGINE_BIT_PARALLEL);
+            Timing automatic = time_engine(&as, &bs, 1, DIFF_ENGINE_AUTO);
+            Timing dp = time_dp(as, bs, table);
+
+            if (myers.edits != bit.edits || myers.edits != automatic.edits || myers.edits != dp.edits) {
+                printf("engines disagree on the edit distance: %zu, %zu, %zu, %zu\n", myers.edits, bit.edits, automatic.edits, dp.edits);
+                return 1;
+            }
+            printf("    %6zu %6zu %6zu %12.1f %12.1f %12.1f %12.1f\n", len, k, myers.edits, myers.us, bit.us, automatic.us, dp.us);
+
+            // interpolate the edit count at which Myers gets slower than the bit-parallel kernel
+            if (crossing_edits == 0 && myers.us > bit.us && prev_myers.us > 0) {
+                double before = prev_bit.us - prev_myers.us, after = myers.us - bit.us;
+                crossing_edits = (double) prev_myers.edits + (double) (myers.edits - prev_myers.edits) * before / (before + after);
+            }
+            prev_myers = myers;
+            prev_bit = bit;
+        }
+
+        if (crossing_edits > 0) {
+            add_crossing(&random_crossings, crossing_edits, len);
+            printf("    Myers gets slower past about %.0f edits\n", crossing_edits);
+        }
+    }
+    print_fit(&random_crossings, "random lines");
+
+    // the prompts people actually type are what the constants in src/diff.c are tuned on
+    Crossings dataset_crossings = {0};
+    bench_builtin_datasets(&rng, &dataset_crossings);
+    print_fit(&dataset_crossings, "built-in dataset lines");
+
+    free(table);
+    free(b);
+    free(a);
+    return 0;
+}
@@ -0,0 +1,190 @@
+// Without arguments benches synthetic lines and the built-in datasets, otherwise the dataset files given,
+// e.g. out/bench_line-scan-release.elf words.txt
+#include "builtin-datasets.h" // for builtin_datasets
+#include "dataset.h"          // for DataSet, dataset_from_compressed_blocks, dataset_element
+#include "line-scan.h"        // for scan_line_ends
+#include "rng.h"              // for Rng, rng_from_seed, rng_below
+#include "timespan.h"         // for TimeSpanSec, now
+
+#include <stdio.h>  // for printf, fopen, fread
+#include <stdlib.h> // for malloc, realloc, free
+#include <string.h> // for memchr, memcpy
+
+#define BENCH_CONTENT_LEN (256u << 20)
+// smaller datasets are repeated up to this size, so that one scan takes long enough to time
+#define BENCH_TILED_LEN   (64u << 20)
+#define BENCH_BATCH       4096
+#define BENCH_RUNS        5
+
+typedef size_t (*ScanFn)(StringView content, size_t* out_ends, size_t out_cap);
+
+static size_t scan_simd(StringView content, size_t* out_ends, size_t out_cap) {
+    size_t from = 0, total = 0, count;
+    while ((count = scan_line_ends(content, &from, out_ends, out_cap)) > 0) total += count;
+    return total;
+}
+
+// what parse_dataset_elements did before scan_line_ends, one memchr per line
+static size_t scan_memchr(StringView content, size_t* out_ends, size_t out_cap) {
+    size_t from = 0, total = 0, count = 0;
+    const char* nl;
+    while ((nl = memchr(content.data + from, '\n', content.len - from)) != NULL) {
+        out_ends[count++] = (size_t) (nl - content.data);
+        from = out_ends[count - 1] + 1;
+        if (count == out_cap) {
+            total += count;
+            count = 0;
+        }
+    }
+    return total + count;
+}
+
+static size_t scan_bytes(StringView content, size_t* out_ends, size_t out_cap) {
+    size_t total = 0, count = 0;
+    for (size_t i = 0; i < content.len; ++i) {
+        if (content.data[i] != '\n') continue;
+        out_ends[count++] = i;
+        if (count == out_cap) {
+            total += count;
+            count = 0;
+        }
+    }
+    return total + count;
+}
+
+static double bench_scan(const char* name, ScanFn scan, StringView content, size_t* out_ends, size_t expected_count) {
+    TimeSpanSec best = 0;
+    for (int run = 0; run < BENCH_RUNS; ++run) {
+        TimeSpanSec start = now();
+        size_t count = scan(content, out_ends, BENCH_BATCH);
+        TimeSpanSec elapsed = now() - start;
+
+        if (count != expected_count) {
+            printf("%s found %zu lines instead of %zu\n", name, count, expected_count);
+            exit(1);
+        }
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+
+    double gbps = (double) content.len / best / 1e9;
+    printf("    %-24s %6.2f GB/s\n", name, gbps);
+    return gbps;
+}
+
+static void bench_line_lengths(const char* title, size_t min_len, size_t max_len, size_t* out_ends) {
+    char* data = malloc(BENCH_CONTENT_LEN);
+    if (data == NULL) exit(1);
+
+    Rng rng = rng_from_seed(1);
+    size_t lines = 0;
+    for (size_t i = 0; i < BENCH_CONTENT_LEN;) {
+        size_t len = min_len + rng_below(&rng, max_len - min_len + 1);
+        for (size_t j = 0; j < len && i < BENCH_CONTENT_LEN; ++j) data[i++] = (char) ('a' + rng_below(&rng, 26));
+        if (i < BENCH_CONTENT_LEN) {
+            data[i++] = '\n';
+            lines++;
+        }
+    }
+
+    StringView content = sv_from_data_and_len(data, BENCH_CONTENT_LEN);
+    printf("%s, %u MB:\n", title, BENCH_CONTENT_LEN >> 20);
+    double simd = bench_scan("scan_line_ends", scan_simd, content, out_ends, lines);
+    double per_line = bench_scan("memchr per line", scan_memchr, content, out_ends, lines);
+    double bytes = bench_scan("byte loop", scan_bytes, content, out_ends, lines);
+    printf("    scan_line_ends is %.1fx memchr per line, %.1fx the byte loop\n", simd / per_line, simd / bytes);
+
+    free(data);
+}
+
+// Benches `text` as is, or repeated up to BENCH_TILED_LEN when it is smaller
+static void bench_dataset_text(const char* title, const char* text, size_t len, size_t* out_ends) {
+    if (len == 0) return;
+
+    size_t tiled_len = len;
+    if (len < BENCH_TILED_LEN) tiled_len = BENCH_TILED_LEN / len * len;
+
+    char* data = malloc(tiled_len);
+    if (data == NULL) exit(1);
+    for (size_t i = 0; i < tiled_len; i += len) memcpy(data + i, text, len);
+
+    StringView content = sv_from_data_and_len(data, tiled_len);
+    size_t lines = scan_bytes(content, out_ends, BENCH_BATCH);
+    printf("%s, %zu lines in %zu bytes%s:\n", title, lines * len / tiled_len, len, tiled_len > len ? ", repeated" : "");
+    double simd = bench_scan("scan_line_ends", scan_simd, content, out_ends, lines);
+    double per_line = bench_scan("memchr per line", scan_memchr, content, out_ends, lines);
+    double bytes = bench_scan("byte loop", scan_bytes, content, out_ends, lines);
+    printf("    scan_line_ends is %.1fx memchr per line, %.1fx the byte loop\n", simd / per_line, simd / bytes);
+
+    free(data);
+}
+
+static void bench_builtin_datasets(size_t* out_ends) {
+    for (size_t d = 0; d < builtin_datasets_count; ++d) {
+        DataSet dataset = dataset_from_compressed_blocks(builtin_datasets[d].blocks);
+        if (dataset_is_null(&dataset)) continue;
+
+        // the decompressed text, every element back on its own line
+        size_t len = 0, cap = 0;
+        char* text = NULL;
+        for (size_t i = 0; i < dataset.elements_count; ++i) {
+            StringView element = dataset_element(&dataset, i);
+            if (len + element.len + 1 > cap) {
+                cap = 2 * (len + element.len + 1);
+                text = realloc(text, cap);
+                if (text == NULL) exit(1);
+            }
+            memcpy(text + len, element.data, element.len);
+            len += element.len;
+            text[len++] = '\n';
+        }
+
+        char title[128];
+        StringView name = builtin_datasets[d].name;
+        snprintf(title, sizeof title, "Built-in @%.*s", (int) name.len, name.data);
+        bench_dataset_text(title, text, len, out_ends);
+
+        free(text);
+        free_dataset(&dataset);
+    }
+}
+
+static bool bench_dataset_file(const char* path, size_t* out_ends) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) goto e1;
+    if (fseek(file, 0, SEEK_END) != 0) goto e2;
+    long len = ftell(file);
+    if (len < 0 || fseek(file, 0, SEEK_SET) != 0) goto e2;
+
+    char* text = malloc(len > 0 ? (size_t) len : 1);
+    if (text == NULL) goto e2;
+    if (fread(text, 1, (size_t) len, file) != (size_t) len) goto e3;
+    fclose(file);
+
+    bench_dataset_text(path, text, (size_t) len, out_ends);
+    free(text);
+    return true;
+
+e3: free(text);
+e2: fclose(file);
+e1: printf("%s could not be read\n", path);
+    return false;
+}
+
+int main(int argc, char** argv) {
+    size_t* out_ends = malloc(BENCH_BATCH * sizeof(*out_ends));
+    if (out_ends == NULL) return 1;
+
+    printf("Newline scanning\n");
+    bool ok = true;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) ok = bench_dataset_file(argv[i], out_ends) && ok;
+    } else {
+        bench_line_lengths("Words (2-12 bytes)", 2, 12, out_ends);
+        bench_line_lengths("Sentences (20-120 bytes)", 20, 120, out_ends);
+        bench_line_lengths("Paragraphs (500-2000 bytes)", 500, 2000, out_ends);
+        bench_builtin_datasets(out_ends);
+    }
+
+    free(out_ends);
+    return ok ? 0 : 1;
+}
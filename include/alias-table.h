@@ -0,0 +1,32 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include "rng.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Walker/Vose alias table: O(count) to build, O(1) per draw, 8 bytes per entry.
+typedef struct AliasTable {
+    // a column is kept when the low 32 bits of the draw are below its threshold, otherwise its alias is taken
+    uint32_t* thresholds;
+    uint32_t* aliases;
+    size_t count;
+} AliasTable;
+
+#define ALIAS_TABLE_NULL ((AliasTable) { 0 })
+
+// Fails if there are more than UINT32_MAX weights, none of them is positive or the allocation fails.
+// Negative and non-finite weights count as 0. `weights` is used as scratch space and clobbered,
+// which keeps the peak memory of tables over millions of entries at 20 bytes per entry.
+bool build_alias_table(AliasTable* table, double* weights, size_t count);
+void free_alias_table(AliasTable* table);
+
+static inline size_t alias_table_sample(const AliasTable* table, Rng* rng) {
+    uint64_t r = rng_next(rng);
+    size_t column = (size_t) (((r >> 32) * (uint64_t) table->count) >> 32);
+    return (uint32_t) r < table->thresholds[column] ? column : table->aliases[column];
+}
+
+#endif // ALIAS_TABLE_H
@@ -3,33 +3,65 @@
 
 #include "timespan.h"
 #include "cli-args.h"
+#include "datasets-utils.h"
+#include "prompt-queue.h"
+#include "terminal-input.h"
+#include "rng.h"
+#include "diff.h"
+#include "input-compare.h"
 
-#define LINE_INPUT_BUF_INITIAL_CAPACITY 32
+// room past the longest prompt for typos, the buffer only grows when even that is not enough
+#define LINE_INPUT_BUF_SLACK 64
 typedef struct TpvLine {
-    char* input_buf;
-    size_t input_cap;
+    char* input_buf; // TpvApp.line_buf, valid until the next line is read
     size_t input_len;
     TimeSpanSec typing_time;
     TimeSpanSec typing_time_per_char;
+    // Ctrl-C, Ctrl-D or the end of input
+    bool interrupted;
+    // a time limit ran out before Enter, only in raw mode
+    bool timed_out;
 } TpvLine;
 
-#define TPV_LINE_NULL ((TpvLine) { 0 })
-
-TpvLine tpv_read_line(const char* prompt, StringView expected_input);
-void tpv_free_line(TpvLine* line);
-
 typedef struct TpvApp {
     CliArgs args;
+    DataSetsSampler sampler;
+    PromptQueue prompts; // owns the sampler and `rng` while the game is running
+    // picked once from the flags, the queue normalizes prompts for it
+    InputComparator comparator;
+
+    uint64_t seed;
+    Rng rng;          // prompt selection, depends on nothing but the seed
+    Rng messages_rng; // praise and retry messages
+    // no-repeat position of the prompt on screen, so that a resumed session starts with it again
+    uint64_t no_repeat_resume_position;
 
     size_t entered_items_count;
     TimeSpanSec typing_times_sum;
     TimeSpanSec typing_times_per_char_sum;
 
     size_t incorrect_count, correct_count;
+    // summed over the diffs of every mistaken line
+    DiffMistakes mistakes;
+    // from the keystrokes of lines typed in raw mode
+    size_t erased_count;
+    TimeSpanSec key_intervals_sum;
+    size_t key_intervals_count;
+    TimeSpanSec longest_hesitation;
+
+    // raw when stdin is a terminal, lines are then read key by key
+    TerminalInput terminal;
+    KeyEvents key_events; // of the last line read in raw mode
+
+    // shared by every line read, sized from the longest prompt up front
+    char* line_buf;
+    size_t line_cap;
 
     bool running;
 } TpvApp;
 
+TpvLine tpv_read_line(TpvApp* app, const char* prompt, const Prompt* expected_input);
+
 TpvApp tpv_init(int argc, char** argv);
 void tpv_free(TpvApp* app);
 void tpv_run(TpvApp* app);
@@ -0,0 +1,12 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Decompresses one block produced by the LZ compressor in nob.c (an LZ4-like byte format: a token with
+// 4-bit literal and match lengths, the literals, a 16-bit little-endian match offset, length extensions
+// as runs of 255). Fails on malformed input or if the output is not exactly `dst_len` bytes long.
+bool decompress_block(const unsigned char* src, size_t src_len, char* dst, size_t dst_len);
+
+#endif // BLOCK_COMPRESSION_H
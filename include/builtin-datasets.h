@@ -1,13 +1,23 @@
 #ifndef BUILTIN_DATASETS_H
 #define BUILTIN_DATASETS_H 
 
+#include "sv.h"
+#include "dataset.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
 #define INCBIN_PREFIX embed_
 #define INCBIN_STYLE INCBIN_STYLE_SNAKE
 #include <incbin/incbin.h>
 
-INCTXT_EXTERN(english_words);
-INCTXT_EXTERN(english_sentences);
-INCTXT_EXTERN(code_snippets);
+typedef struct BuiltinDatasetEntry {
+    StringView name;
+    DataSetBlocks blocks;
+} BuiltinDatasetEntry;
 
-#endif // BUILTIN_DATASETS_H
+// Generated by nob.c from assets/builtin-datasets, one entry per <name>.txt file
+extern const BuiltinDatasetEntry builtin_datasets[];
+extern const size_t builtin_datasets_count;
 
+#endif // BUILTIN_DATASETS_H
@@ -7,6 +7,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct CliSwitch {
     bool value;
@@ -18,29 +19,60 @@ typedef struct CliTimeSpanOption {
     bool set;
 } CliTimeSpanOption;
 
+typedef struct CliSizeOption {
+    size_t value;
+    bool set;
+} CliSizeOption;
+
+typedef struct CliUint64Option {
+    uint64_t value;
+    bool set;
+} CliUint64Option;
+
 bool set_cli_switch(StringView name, CliSwitch* cswitch, bool value);
 
 #ifndef MAX_DATASETS
 #   define MAX_DATASETS 128
 #endif
 
+// --weight <dataset>=<weight>, the dataset is spelled the same way it was passed
+typedef struct CliWeight {
+    StringView dataset_name;
+    double value;
+} CliWeight;
+
 typedef struct CliArgs {
     DataSet datasets[MAX_DATASETS];
+    StringView dataset_names[MAX_DATASETS];
+    double dataset_weights[MAX_DATASETS];
     size_t datasets_count;
 
     GeneratorDataset generator_datasets[MAX_DATASETS];
+    StringView generator_dataset_names[MAX_DATASETS];
+    double generator_dataset_weights[MAX_DATASETS];
     size_t generator_datasets_count;
 
+    CliWeight weights[MAX_DATASETS];
+    size_t weights_count;
+
     CliTimeSpanOption time_limit;
     CliTimeSpanOption time_per_char_limit;
 
+    CliSizeOption index_threads;
+    CliSizeOption markov_order;
+    CliUint64Option seed;
+    CliUint64Option no_repeat_from;
+
     CliSwitch retry;
+    CliSwitch repeat;
     CliSwitch game_over_on_mistake;
     CliSwitch game_over_on_exceed_time_limit;
     CliSwitch game_over_on_exceed_time_per_char_limit;
 
     CliSwitch ignore_case;
     CliSwitch ignore_punctuations;
+    CliSwitch live; // colour the input while it is typed, terminals only
+    CliSwitch word_diff;
 
     bool is_null;
 } CliArgs;
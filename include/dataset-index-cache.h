@@ -0,0 +1,45 @@
+#ifndef DATASET_INDEX_CACHE_H
+#define DATASET_INDEX_CACHE_H
+
+#include "sv.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define DATASET_INDEX_CACHE_SUFFIX ".tpvidx"
+
+// Line end tables use 32-bit offsets whenever the content fits in them, 4 bytes per element.
+static inline size_t line_end_size_for(size_t content_len) {
+    return content_len <= UINT32_MAX ? sizeof(uint32_t) : sizeof(uint64_t);
+}
+
+static inline uint64_t line_end_at(const void* line_ends, size_t line_end_size, size_t index) {
+    return line_end_size == sizeof(uint32_t)
+        ? ((const uint32_t*) line_ends)[index]
+        : ((const uint64_t*) line_ends)[index];
+}
+
+typedef struct DataSetIndexCache {
+    // offset of the '\n' terminating each element, pointing into `_mapping`
+    const void* line_ends;
+    size_t line_end_size;
+    size_t elements_count;
+
+    void* _mapping;
+    size_t _mapping_len;
+} DataSetIndexCache;
+
+#define DATASET_INDEX_CACHE_NULL ((DataSetIndexCache) { 0 })
+
+// Only compares the source's size, mtime and inode with the ones the index was stored for, O(1)
+bool dataset_index_cache_load(const char* filepath, const struct stat* source_stat,
+                              size_t line_end_size, DataSetIndexCache* out_cache);
+bool dataset_index_cache_store(const char* filepath, const struct stat* source_stat, StringView raw_content,
+                               const void* line_ends, size_t line_end_size, size_t elements_count);
+// Checks every byte of the content against the hash taken when the index was stored, and every line end
+// of the table against the content, O(file size). Meant for a background thread.
+bool dataset_index_cache_verify(const DataSetIndexCache* cache, StringView raw_content);
+void dataset_index_cache_free(DataSetIndexCache* cache);
+
+#endif // DATASET_INDEX_CACHE_H
@@ -2,13 +2,53 @@
 #define DATASET_H
 
 #include "sv.h"
+#include "dataset-index-cache.h"
+#include "alias-table.h"
+#include "rng.h"
 
+#include <stdint.h>
+
+typedef struct DataSetIndexer DataSetIndexer;
+
+// Content split into independently compressed blocks of whole lines, see block-compression.h
+#define DATASET_BLOCK_SIZE (64 * 1024)
+// so that the line ends of a decompressed block fit a fixed array
+#define DATASET_BLOCK_MAX_LINES 8192
+
+typedef struct DataSetBlocks {
+    // (compressed start, uncompressed start, first element) of every block, plus one triple marking the end
+    const uint32_t* offsets;
+    size_t blocks_count;
+    size_t longest_element_len;
+    const unsigned char* data;
+} DataSetBlocks;
+
+// A line may end with a weight column, `word<TAB>weight`, to be drawn more or less often than the others.
+// Whether a dataset is weighted is decided by its first line, lines without the column then weigh 1.
 typedef struct DataSet {
-    StringView* elements;
+    // offset of the '\n' terminating each element within `raw_content`, `line_end_size` bytes each,
+    // use dataset_element to access the elements. NULL for compressed datasets, their blocks know their lines
+    const void* line_ends;
+    size_t line_end_size;
     size_t elements_count;
     StringView raw_content;
 
+    void* _line_ends_owned;
     char* _raw_content_owned;
+    void* _mapping;
+    size_t _mapping_len;
+    DataSetIndexCache _index_cache;
+    // set for compressed datasets, `raw_content` then holds the compressed bytes
+    DataSetBlocks _blocks;
+
+    // lines end with a `<TAB>weight` column, which is cut off the elements
+    bool _weighted;
+    // one column per element once the full index is known, empty until then and for unweighted datasets
+    AliasTable _weights;
+
+    // non-NULL while the full line index is still being built in the background;
+    // until then `line_ends` only covers the head of the file
+    DataSetIndexer* _indexer;
 } DataSet;
 
 #define DATASET_NULL ((DataSet) { 0 })
@@ -17,10 +57,23 @@ static inline bool dataset_is_null(DataSet* dataset) {
     return sv_is_null(dataset->raw_content);
 }
 
-DataSet load_dataset(StringView filepath);
+// `index_threads` is the number of threads used to index large files, 0 picks dataset_default_index_threads()
+DataSet load_dataset(StringView filepath, size_t index_threads);
 DataSet parse_dataset_from_str(StringView raw_content);
+// Wraps an already built line end table, neither the content nor the table is copied or freed
+DataSet dataset_from_line_ends(StringView raw_content, const void* line_ends, size_t line_end_size, size_t elements_count);
+// Same as dataset_from_line_ends, but blocks are decompressed only once an element inside them is requested
+DataSet dataset_from_compressed_blocks(DataSetBlocks blocks);
 void free_dataset(DataSet* dataset);
-StringView random_dataset_element(DataSet* dataset);
 
-#endif // DATASET_H
+size_t dataset_default_index_threads(void);
+void dataset_poll_index(DataSet* dataset);
+void dataset_wait_index(DataSet* dataset);
+// Elements of compressed datasets live in a per-thread cache of decompressed blocks, they stay valid
+// until the same thread has decompressed DATASET_BLOCK_CACHE_SLOTS other blocks.
+StringView dataset_element(DataSet* dataset, size_t index);
+StringView random_dataset_element(DataSet* dataset, Rng* rng);
+// Of the elements indexed so far, weight columns included
+size_t dataset_longest_element_len(DataSet* dataset);
 
+#endif // DATASET_H
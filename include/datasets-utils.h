@@ -3,12 +3,68 @@
 
 #include "dataset.h"
 #include "generator-dataset.h"
+#include "alias-table.h"
+#include "permutation.h"
+#include "rng.h"
 #include "sv.h"
 
-StringView random_element_from_many_datasets(DataSet* datasets, size_t datasets_count);
+#define GENERATOR_BATCH_SIZE 64
 
-StringView random_element(DataSet* real, size_t real_count,
-                          GeneratorDataset* gen, size_t gen_count,
-                          double gen_prob);
-#endif // DATASETS_UTILS
+// Prompts generated ahead in one gen_batch call, handed out one by one
+typedef struct GeneratorBatch {
+    StringView items[GENERATOR_BATCH_SIZE];
+    size_t count, next;
+    char arena[GENERATOR_BATCH_SIZE * GENERATOR_DATASET_MAX_LEN];
+} GeneratorBatch;
+
+typedef struct DataSetsSampler {
+    DataSet* datasets;
+    const double* dataset_weights;
+    size_t datasets_count;
+
+    GeneratorDataset* generators;
+    const double* generator_weights;
+    size_t generators_count;
+    GeneratorBatch* generator_batches;
+
+    // probability of drawing from a generator when every weight is 1, scaled by the generators ratio
+    double generator_prob;
+
+    // one column per source: datasets first, then generators
+    AliasTable sources;
+    // datasets still being indexed in the background, their element counts may still grow
+    size_t pending_indexes_count;
+
+    // no-repeat mode walks one permutation of all dataset elements, rekeyed on every pass over them,
+    // instead of drawing each prompt independently
+    bool no_repeat;
+    uint64_t no_repeat_key;
+    uint64_t no_repeat_position; // dataset prompts handed out so far, including those of earlier runs
+    Permutation no_repeat_order; // of the pass `no_repeat_position` is in
+    // cumulative_counts[i] is the number of elements in datasets [0, i]
+    size_t* cumulative_counts;
+
+    bool is_null;
+} DataSetsSampler;
 
+#define DATASETS_SAMPLER_NULL ((DataSetsSampler) { .is_null = true })
+
+static inline bool datasets_sampler_is_null(DataSetsSampler* sampler) {
+    return sampler->is_null;
+}
+
+// Weights scale the chance of each source, NULL means all of them are 1.
+// A dataset's chance is proportional to its weight times its element count.
+DataSetsSampler init_datasets_sampler(DataSet* real, const double* real_weights, size_t real_count,
+                                      GeneratorDataset* gen, const double* gen_weights, size_t gen_count,
+                                      double gen_prob);
+void free_datasets_sampler(DataSetsSampler* sampler);
+
+// Every dataset element is then drawn once before any of them repeats, regardless of dataset and line weights.
+// Expects the datasets to be fully indexed, pass the position of an earlier run with the same key to resume it.
+bool datasets_sampler_enable_no_repeat(DataSetsSampler* sampler, uint64_t key, uint64_t position);
+
+// Generated elements stay valid for GENERATOR_BATCH_SIZE more draws from their generator
+StringView random_element(DataSetsSampler* sampler, Rng* rng);
+
+#endif // DATASETS_UTILS
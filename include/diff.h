@@ -2,7 +2,63 @@
 #define DIFF_H
 
 #include "sv.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    DIFF_EQUAL,
+    DIFF_DELETE, // in `a` only
+    DIFF_INSERT, // in `b` only
+} DiffOp;
+
+typedef struct DiffSpan {
+    DiffOp op;
+    size_t len;
+} DiffSpan;
+
+// Shortest edit script turning `a` into `b` as runs of the same operation. Between two DIFF_EQUAL spans
+// there is at most one DIFF_DELETE span followed by at most one DIFF_INSERT span.
+typedef struct DiffEditScript {
+    DiffSpan* spans;
+    size_t spans_count;
+    size_t deleted_count, inserted_count;
+    bool is_null;
+} DiffEditScript;
+
+#define DIFF_EDIT_SCRIPT_NULL ((DiffEditScript) { .is_null = true })
+
+static inline bool diff_edit_script_is_null(const DiffEditScript* script) {
+    return script->is_null;
+}
+
+DiffEditScript diff_edit_script(StringView a, StringView b);
+// Lines up words, identifiers, whitespace runs and single symbols first, then only diffs the characters of
+// the tokens that changed. Much cheaper on long lines, and a misspelt word shows up as one change.
+DiffEditScript diff_edit_script_by_tokens(StringView a, StringView b);
+void free_diff_edit_script(DiffEditScript* script);
+
+// DIFF_ENGINE_AUTO picks per line, it is what the functions above use. The others force one engine
+// for every line, so that they can be measured against each other.
+typedef enum {
+    DIFF_ENGINE_AUTO,
+    DIFF_ENGINE_MYERS,
+    DIFF_ENGINE_BIT_PARALLEL,
+} DiffEngine;
+
+DiffEditScript diff_edit_script_with_engine(StringView a, StringView b, DiffEngine engine);
+
+// Mistyped characters of `b` against the expected `a`, each change run counts as
+// substitutions as far as its deleted and inserted parts line up, the rest is missing or extra
+typedef struct DiffMistakes {
+    size_t substituted, missing, extra;
+} DiffMistakes;
+
+DiffMistakes diff_count_mistakes(const DiffEditScript* script);
+
+// Writes `a` with what `b` lacks in red and what it adds in green, then a newline, in a single write to `fd`.
+// Whatever stdout has buffered is flushed first so that the diff lands after it.
+bool render_diff(int fd, StringView a, StringView b, const DiffEditScript* script);
 void print_diff(StringView a, StringView b);
 
 #endif // DIFF_H
-
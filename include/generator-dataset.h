@@ -2,15 +2,42 @@
 #define GENERATOR_DATASET_H
 
 #include "sv.h"
+#include "rng.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// longest prompt a generator may produce
+#define GENERATOR_DATASET_MAX_LEN 256
 
 typedef struct GeneratorDataset {
-    StringView (*gen)();
+    // Fills up to `count` prompts into `arena` and points `out` at them, stopping early once the next one
+    // does not fit. Returns how many were written. Reentrant, the only mutable state is `rng`.
+    size_t (*gen_batch)(const void* context, Rng* rng, char* arena, size_t arena_cap, StringView* out, size_t count);
+    const void* context;
+    Rng rng;
+
+    void* _context_owned;
 } GeneratorDataset;
 
 #define GENERATOR_DATASET_NULL ((GeneratorDataset) { 0 }) 
 
 static inline bool generator_dataset_is_null(GeneratorDataset* gd) {
-    return gd->gen == NULL;
+    return gd->gen_batch == NULL;
+}
+
+static inline void seed_generator_dataset(GeneratorDataset* gd, uint64_t seed) {
+    gd->rng = rng_from_seed(seed);
+}
+
+static inline size_t generator_dataset_gen_batch(GeneratorDataset* gd, char* arena, size_t arena_cap, StringView* out, size_t count) {
+    return gd->gen_batch(gd->context, &gd->rng, arena, arena_cap, out, count);
+}
+
+static inline void free_generator_dataset(GeneratorDataset* gd) {
+    free(gd->_context_owned);
 }
 
 extern GeneratorDataset
@@ -19,4 +46,3 @@ extern GeneratorDataset
         random_numbers_generator_dataset;
 
 #endif // GENERATOR_DATASET_H
-
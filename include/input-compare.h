@@ -0,0 +1,26 @@
+#ifndef INPUT_COMPARE_H
+#define INPUT_COMPARE_H
+
+#include "sv.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// `expected` has already been through input_comparator_normalize
+typedef bool (*InputEqlFn)(StringView input, StringView expected);
+
+// A comparator specialized for one combination of the flags, picked once per session.
+// Punctuation is skipped on both sides and letters compare case-insensitively, as asked.
+typedef struct InputComparator {
+    bool ignore_case;
+    bool ignore_punctuations;
+    InputEqlFn eql;
+} InputComparator;
+
+InputComparator input_comparator(bool ignore_case, bool ignore_punctuations);
+
+// Writes `expected` to `out` (room for expected.len bytes) without punctuation and case folded, as far
+// as the comparator ignores them, and returns the written length. Only needs to happen once per prompt.
+size_t input_comparator_normalize(const InputComparator* comparator, StringView expected, char* out);
+
+#endif // INPUT_COMPARE_H
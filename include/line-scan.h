@@ -0,0 +1,16 @@
+#ifndef LINE_SCAN_H
+#define LINE_SCAN_H
+
+#include "sv.h"
+
+#include <stddef.h>
+
+// Writes the offsets of the next '\n' characters of `content`, starting at `*io_from`, to `out_ends`
+// and advances `*io_from` past the scanned bytes. Stops when `out_cap` offsets were written or the
+// content ends. Returns the number of written offsets, 0 means there are no more newlines.
+size_t scan_line_ends(StringView content, size_t* io_from, size_t* out_ends, size_t out_cap);
+
+// Returns the number of '\n' characters in `content`.
+size_t count_line_ends(StringView content);
+
+#endif // LINE_SCAN_H
@@ -0,0 +1,33 @@
+#ifndef LIVE_MATCH_H
+#define LIVE_MATCH_H
+
+#include "sv.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    LIVE_CELL_CORRECT,
+    LIVE_CELL_INCORRECT,
+    LIVE_CELL_IGNORED, // punctuation typed with ignore_punctuations
+} LiveCell;
+
+// Compares a line against the prompt while it is typed, with the same rules as InputComparator.
+// Pushing or erasing a byte is O(1) besides the run of prompt punctuation it steps over when
+// punctuation is ignored. Typed bytes line up with the prompt one to one, so after the first
+// mistake every cell is judged against the prompt byte at the same position.
+typedef struct LiveMatch {
+    StringView expected;
+    bool ignore_case;
+    bool ignore_punctuations;
+
+    size_t expected_pos; // next significant byte of `expected`
+    size_t excess_count; // significant bytes typed past the end of `expected`
+} LiveMatch;
+
+LiveMatch live_match_start(StringView expected, bool ignore_case, bool ignore_punctuations);
+LiveCell live_match_push(LiveMatch* match, char c);
+// `c` is the last byte pushed, the one being erased
+void live_match_pop(LiveMatch* match, char c);
+
+#endif // LIVE_MATCH_H
@@ -0,0 +1,17 @@
+#ifndef MARKOV_GENERATOR_H
+#define MARKOV_GENERATOR_H
+
+#include "dataset.h"
+#include "generator-dataset.h"
+
+#include <stddef.h>
+
+#define MARKOV_MAX_ORDER     7
+#define MARKOV_DEFAULT_ORDER 3
+
+// Trains an order-`order` character model on every element of `dataset` and returns a generator of
+// pseudo-words following the same letter statistics. The dataset is only read during the call.
+// `threads` works like for load_dataset, returns GENERATOR_DATASET_NULL on failure.
+GeneratorDataset train_markov_generator_dataset(DataSet* dataset, size_t order, size_t threads);
+
+#endif // MARKOV_GENERATOR_H
@@ -1,10 +1,12 @@
 #ifndef MESSAGES_H
 #define MESSAGES_H
 
+#include "rng.h"
+
 #include <stdlib.h>
 #include <stddef.h>
 
-static inline const char* tpv_get_random_praise() {
+static inline const char* tpv_get_random_praise(Rng* rng) {
     static const char* messages[] = {
         "Good!",
         "Excellent!",
@@ -40,10 +42,10 @@ static inline const char* tpv_get_random_praise() {
     };
     size_t messages_count = sizeof messages / sizeof messages[0];
 
-    return messages[rand() % messages_count];
+    return messages[rng_below(rng, messages_count)];
 }
 
-static inline const char* tpv_get_random_retry_message() {
+static inline const char* tpv_get_random_retry_message(Rng* rng) {
     static const char* messages[] = {
         "Try again!",
         "Almost!",
@@ -78,10 +80,10 @@ static inline const char* tpv_get_random_retry_message() {
     };
     size_t messages_count = sizeof messages / sizeof messages[0];
 
-    return messages[rand() % messages_count];
+    return messages[rng_below(rng, messages_count)];
 }
 
-static inline const char* tpv_get_random_goodbye_message() {
+static inline const char* tpv_get_random_goodbye_message(Rng* rng) {
     static const char* messages[] = {
         "Goodbye!",
         "See you later!",
@@ -90,7 +92,7 @@ static inline const char* tpv_get_random_goodbye_message() {
     };
     size_t messages_count = sizeof messages / sizeof messages[0];
 
-    return messages[rand() % messages_count];
+    return messages[rng_below(rng, messages_count)];
 }
 
 #endif // MESSAGES_H
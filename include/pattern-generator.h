@@ -0,0 +1,21 @@
+#ifndef PATTERN_GENERATOR_H
+#define PATTERN_GENERATOR_H
+
+#include "sv.h"
+#include "generator-dataset.h"
+
+#include <stddef.h>
+
+// Compiles a pattern such as `[a-z]{3,8}[0-9]{2}` or `0x[0-9a-f]{8}` into a generator dataset.
+//
+//   [...]  one character of a class, with ranges (`a-z`) and negation (`[^...]`, over printable ASCII)
+//   .      any printable ASCII character but space
+//   \c     the character c itself
+//   {n}, {n,m}, ?  repeat the preceding character or class
+//
+// Anything else stands for itself. Every prompt must be at least one character long, so a pattern
+// such as `a?` is rejected. On failure GENERATOR_DATASET_NULL is returned,
+// and `out_error` is set to a static message and `out_error_pos` to where it happened.
+GeneratorDataset compile_pattern_generator_dataset(StringView pattern, const char** out_error, size_t* out_error_pos);
+
+#endif // PATTERN_GENERATOR_H
@@ -0,0 +1,59 @@
+#ifndef PERMUTATION_H
+#define PERMUTATION_H
+
+#include "rng.h"
+
+#include <stdint.h>
+
+#define PERMUTATION_ROUNDS 6
+
+// Keyed pseudo-random permutation of [0, domain) in O(1) memory: a balanced Feistel network over the
+// smallest even number of bits covering the domain, cycle walking past the values outside of it.
+typedef struct Permutation {
+    uint64_t domain;
+    unsigned half_bits;
+    uint64_t half_mask;
+    uint64_t round_keys[PERMUTATION_ROUNDS];
+} Permutation;
+
+static inline Permutation permutation_from_key(uint64_t domain, uint64_t key) {
+    Permutation permutation = { .domain = domain };
+
+    unsigned bits = domain > 1 ? 64 - (unsigned) __builtin_clzll(domain - 1) : 0;
+    permutation.half_bits = bits > 2 ? (bits + 1) / 2 : 1;
+    permutation.half_mask = (1ull << permutation.half_bits) - 1;
+
+    for (int i = 0; i < PERMUTATION_ROUNDS; ++i) {
+        permutation.round_keys[i] = splitmix64(&key);
+    }
+    return permutation;
+}
+
+static inline uint64_t permutation_round(uint64_t half, uint64_t round_key) {
+    uint64_t z = half ^ round_key;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// `index` must be below the domain; the domain covers at least a quarter of the
+// Feistel block, so this takes fewer than 4 passes on average
+static inline uint64_t permutation_at(const Permutation* permutation, uint64_t index) {
+    unsigned half_bits = permutation->half_bits;
+    uint64_t mask = permutation->half_mask;
+
+    uint64_t x = index;
+    do {
+        uint64_t left = x >> half_bits, right = x & mask;
+        for (int i = 0; i < PERMUTATION_ROUNDS; ++i) {
+            uint64_t next_right = left ^ (permutation_round(right, permutation->round_keys[i]) & mask);
+            left = right;
+            right = next_right;
+        }
+        x = (left << half_bits) | right;
+    } while (x >= permutation->domain);
+
+    return x;
+}
+
+#endif // PERMUTATION_H
@@ -0,0 +1,60 @@
+#ifndef PROMPT_QUEUE_H
+#define PROMPT_QUEUE_H
+
+#include "sv.h"
+#include "rng.h"
+#include "datasets-utils.h"
+#include "input-compare.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Prompt {
+    // normalized text to be typed, points into `render`
+    StringView text;
+    // the whole "Type ..." line, ready to be written out as is
+    StringView render;
+    // `text` as normalized by the queue's comparator, what input is compared against
+    StringView expected;
+    // no-repeat position the prompt was drawn at
+    uint64_t no_repeat_position;
+
+    char* _buf;
+    size_t _cap;
+} Prompt;
+
+#ifndef PROMPT_QUEUE_CAPACITY
+#   define PROMPT_QUEUE_CAPACITY 8
+#endif
+
+// Lookahead of prompts drawn by a worker thread, so that moving on to the next prompt is just a pointer swap.
+// The worker is the only one touching the sampler (and through it the datasets, block cache and generators)
+// while the queue is running, prompts are copied out of their datasets before they are handed over.
+typedef struct PromptQueue {
+    DataSetsSampler* sampler;
+    Rng* rng;
+    InputComparator comparator;
+
+    Prompt slots[PROMPT_QUEUE_CAPACITY];
+    size_t written;  // slots filled by the worker so far
+    size_t read;     // slots handed to the consumer so far
+    size_t released; // slots the consumer is done with, it holds at most one
+
+    pthread_mutex_t mutex;
+    pthread_cond_t filled, freed;
+    pthread_t worker;
+    // without a worker thread the slots are filled by prompt_queue_next itself
+    bool has_worker;
+    bool stopping;
+} PromptQueue;
+
+// `sampler` and `rng` must not be used by anyone else until the queue is freed. Slots are allocated for
+// prompts of up to `longest_text_len` bytes up front and only grow when a longer one comes along.
+bool init_prompt_queue(PromptQueue* queue, DataSetsSampler* sampler, Rng* rng, InputComparator comparator, size_t longest_text_len);
+void free_prompt_queue(PromptQueue* queue);
+
+// Releases the previously returned prompt and waits for the next one
+const Prompt* prompt_queue_next(PromptQueue* queue);
+
+#endif // PROMPT_QUEUE_H
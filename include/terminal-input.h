@@ -0,0 +1,107 @@
+#ifndef TERMINAL_INPUT_H
+#define TERMINAL_INPUT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <termios.h>
+
+typedef enum {
+    KEY_EVENT_CHAR,      // a byte of typed text, UTF-8 sequences arrive byte by byte
+    KEY_EVENT_ERASE,     // backspace
+    KEY_EVENT_ENTER,
+    KEY_EVENT_INTERRUPT, // Ctrl-C or Ctrl-D
+    KEY_EVENT_IGNORED,   // escape sequences (arrows, function keys) and other control bytes
+    KEY_EVENT_DEADLINE,  // the deadline set with terminal_input_set_deadline passed, `byte` is 0
+} KeyEventKind;
+
+typedef struct KeyEvent {
+    uint64_t time_ns; // CLOCK_MONOTONIC, see now_ns
+    uint8_t kind;     // KeyEventKind
+    char byte;
+} KeyEvent;
+
+#ifndef KEY_EVENTS_CAPACITY
+#   define KEY_EVENTS_CAPACITY 4096
+#endif
+
+// Keystrokes of one line, events past the capacity are counted but not kept
+typedef struct KeyEvents {
+    KeyEvent* events; // KEY_EVENTS_CAPACITY of them, allocated once up front
+    size_t count;
+    size_t dropped_count;
+} KeyEvents;
+
+static inline void key_events_push(KeyEvents* events, KeyEvent event) {
+    if (events->count < KEY_EVENTS_CAPACITY) events->events[events->count++] = event;
+    else events->dropped_count++;
+}
+
+#define TERMINAL_INPUT_READ_SIZE 64
+
+#ifndef KEY_RING_CAPACITY
+#   define KEY_RING_CAPACITY 1024 // a power of two
+#endif
+
+// Lock-free single-producer/single-consumer queue of keystrokes. Each side owns one index and only
+// publishes it (release) after it is done with the slot, the other side reads it back with acquire.
+typedef struct KeyRing {
+    KeyEvent events[KEY_RING_CAPACITY];
+    _Alignas(64) atomic_size_t head; // next slot to pop, written by the consumer
+    _Alignas(64) atomic_size_t tail; // next slot to push, written by the producer
+} KeyRing;
+
+static inline bool key_ring_push(KeyRing* ring, KeyEvent event) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == KEY_RING_CAPACITY) return false;
+
+    ring->events[tail & (KEY_RING_CAPACITY - 1)] = event;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static inline bool key_ring_pop(KeyRing* ring, KeyEvent* out_event) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&ring->tail, memory_order_acquire)) return false;
+
+    *out_event = ring->events[head & (KEY_RING_CAPACITY - 1)];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+// In raw mode a reader thread does nothing but read `fd`, stamp and classify the keystrokes and push
+// them to `ring`, so that a slow terminal on the output side never delays when a key counts as typed.
+typedef struct TerminalInput {
+    int fd;
+    bool raw;
+    struct termios saved;
+
+    KeyRing ring;
+    pthread_t reader;
+    int wake_fd;        // eventfd bumped by the reader after pushing or closing, -1 when not raw
+    int stop_fd;        // eventfd asking the reader to exit, -1 when not raw
+    atomic_bool closed; // the reader hit the end of input or a read error, set after its last push
+
+    int timer_fd; // CLOCK_MONOTONIC timerfd waking terminal_read_key at the deadline, -1 when not raw
+    uint64_t deadline_ns;
+    // popped from `ring` but typed after the deadline, handed out once the deadline is cleared
+    KeyEvent held;
+    bool has_held;
+} TerminalInput;
+
+// Switches `fd` to raw mode when it is a terminal, returns false and leaves it alone otherwise.
+// The saved mode is also restored at exit, should terminal_input_restore never be reached.
+bool terminal_input_enable_raw(TerminalInput* input, int fd);
+void terminal_input_restore(TerminalInput* input);
+
+// Makes terminal_read_key yield a KEY_EVENT_DEADLINE once now_ns() reaches `deadline_ns`, 0 clears it.
+// Keys typed before the deadline are still handed out first, however late they are popped.
+bool terminal_input_set_deadline(TerminalInput* input, uint64_t deadline_ns);
+
+// Sleeps in poll() until the reader pushes a keystroke or the deadline passes,
+// returns false on end of input or a read error
+bool terminal_read_key(TerminalInput* input, KeyEvent* out_event);
+
+#endif // TERMINAL_INPUT_H
@@ -3,6 +3,7 @@
 
 #include "sv.h"
 
+#include <stdint.h>   // for uint64_t
 #include <time.h>     // for timespec, clock_gettime
 
 typedef double TimeSpanSec;
@@ -13,6 +14,13 @@ static inline TimeSpanSec now() {
     return tp.tv_sec + (tp.tv_nsec / 1e9);
 }
 
+// Same clock as now(), in whole nanoseconds
+static inline uint64_t now_ns() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t) tp.tv_sec * 1000000000ull + (uint64_t) tp.tv_nsec;
+}
+
 bool parse_timespan(StringView str, TimeSpanSec* out_timespan);
 
 #endif // TIMESPAN_H
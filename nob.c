@@ -1,4 +1,6 @@
+#include <ctype.h>
 #include <linux/limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +13,8 @@
 
 #define BUILD_DIR "build/"
 #define OUT_DIR "out/"
+#define GENERATED_DIR BUILD_DIR "generated/"
+#define BUILTIN_DATASETS_DIR "assets/builtin-datasets"
 
 typedef enum BuildMode {
     Debug = 0,
@@ -23,6 +27,8 @@ typedef struct RunCmdOptions RunCmdOptions;
 typedef struct CleanCmdOptions CleanCmdOptions;
 typedef struct RebuildRunCmdOptions RebuildRunCmdOptions;
 typedef struct InstallCmdOptions InstallCmdOptions;
+typedef struct BenchCmdOptions BenchCmdOptions;
+typedef struct TestCmdOptions TestCmdOptions;
 
 typedef union CmdOptions {
     struct BuildCmdOptions {
@@ -49,6 +55,12 @@ typedef union CmdOptions {
     struct InstallCmdOptions {
         BuildCmdOptions build_options;
     } install;
+    struct BenchCmdOptions {
+        BuildCmdOptions build_options;
+    } bench;
+    struct TestCmdOptions {
+        BuildCmdOptions build_options;
+    } test;
 } CmdOptions;
 
 // helper
@@ -187,21 +199,275 @@ bool needs_rebuild(const char *src, const char *obj) {
     return src_stat.st_mtime > obj_stat.st_mtime;
 }
 
-int build(BuildCmdOptions* opts) {
-    chdir_to_project_root();
-    nob_mkdir_if_not_exists(BUILD_DIR);
-    nob_mkdir_if_not_exists(OUT_DIR);
+int compile_object(BuildCmdOptions* opts, Flags* compile_flags, const char* source_path, const char* out_obj_path) {
+    Nob_Cmd cc = {0};
+    nob_cc(&cc);
+    nob_cmd_extend(&cc, compile_flags);
+    nob_cmd_append(&cc, "-Wall", "-Wextra");
+    if (opts->mode == Release) {
+        nob_cmd_append(&cc, "-O3", "-flto", "-DNDEBUG");
+    } else if (opts->mode == Debug) {
+        nob_cmd_append(&cc, "-O0", "-g");
+    }
+    if (opts->use_asan) {
+        nob_cmd_append(&cc, "-fsanitize=address");
+    }
+    if (opts->use_ubsan) {
+        nob_cmd_append(&cc, "-fsanitize=undefined");
+    }
+    nob_cmd_append(&cc, source_path, "-c", "-o", out_obj_path);
 
-    Flags compile_flags = {0}, link_flags = {0};
-    build_external_libs(&compile_flags, &link_flags);
+    bool ok = nob_cmd_run(&cc, .async = false);
+    nob_cmd_free(cc);
+    return ok ? 0 : 1;
+}
+
+typedef struct BuiltinDatasetAsset {
+    const char* name;       // dataset name, e.g. "english-words"
+    const char* ident;      // C identifier, e.g. "english_words"
+    const char* text_path;
+    const char* blob_path;
+    size_t elements_count;
+    size_t longest_element_len;
+    size_t blocks_count;
+    size_t size;
+} BuiltinDatasetAsset;
+
+typedef struct BuiltinDatasetAssets {
+    BuiltinDatasetAsset* items;
+    size_t count;
+    size_t capacity;
+} BuiltinDatasetAssets;
 
-    nob_da_append(&compile_flags, "-Iinclude");
-    nob_da_append(&compile_flags, "-Iexternal");
+typedef struct Uint32s {
+    uint32_t* items;
+    size_t count;
+    size_t capacity;
+} Uint32s;
 
-    chdir_to_project_root();
+int compare_cstrs(const void* a, const void* b) {
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+// Must match DATASET_BLOCK_SIZE and DATASET_BLOCK_MAX_LINES in include/dataset.h
+#define DATASET_BLOCK_SIZE (64 * 1024)
+#define DATASET_BLOCK_MAX_LINES 8192
+
+#define LZ_MIN_MATCH  4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS  14
+
+uint32_t lz_hash4(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+void lz_append_length_extension(Nob_String_Builder* out, size_t len) {
+    for (; len >= 255; len -= 255) nob_da_append(out, (char) 255);
+    nob_da_append(out, (char) len);
+}
+
+void lz_append_sequence(Nob_String_Builder* out, const unsigned char* literals, size_t literals_len, size_t offset, size_t match_len) {
+    size_t match_code = match_len == 0 ? 0 : match_len - LZ_MIN_MATCH;
+    nob_da_append(out, (char) (((literals_len < 15 ? literals_len : 15) << 4) | (match_code < 15 ? match_code : 15)));
+
+    if (literals_len >= 15) lz_append_length_extension(out, literals_len - 15);
+    nob_sb_append_buf(out, (const char*) literals, literals_len);
+    if (match_len == 0) return;
+
+    nob_da_append(out, (char) (offset & 0xff));
+    nob_da_append(out, (char) (offset >> 8));
+    if (match_code >= 15) lz_append_length_extension(out, match_code - 15);
+}
+
+// Greedy LZ77 with a single-entry hash table, decoded by decompress_block in src/block-compression.c
+void lz_compress_block(const unsigned char* src, size_t len, Nob_String_Builder* out) {
+    static int32_t table[1 << LZ_HASH_BITS];
+    for (size_t i = 0; i < NOB_ARRAY_LEN(table); ++i) table[i] = -1;
 
+    size_t anchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= len) {
+        uint32_t h = lz_hash4(src + i);
+        int32_t candidate = table[h];
+        table[h] = (int32_t) i;
+
+        if (candidate < 0 || i - (size_t) candidate > LZ_MAX_OFFSET || memcmp(src + candidate, src + i, LZ_MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+
+        size_t match_len = LZ_MIN_MATCH;
+        while (i + match_len < len && src[candidate + match_len] == src[i + match_len]) match_len++;
+
+        lz_append_sequence(out, src + anchor, i - anchor, i - (size_t) candidate, match_len);
+        i += match_len;
+        anchor = i;
+    }
+
+    lz_append_sequence(out, src + anchor, len - anchor, 0, 0);
+}
+
+void append_dataset_block(Uint32s* block_offsets, Nob_String_Builder* compressed, const char* text, size_t start, size_t end, size_t first_element) {
+    nob_da_append(block_offsets, (uint32_t) compressed->count);
+    nob_da_append(block_offsets, (uint32_t) start);
+    nob_da_append(block_offsets, (uint32_t) first_element);
+    lz_compress_block((const unsigned char*) text + start, end - start, compressed);
+}
+
+// Blob layout, all integers are native-endian uint32:
+//   block_offsets[3 * (blocks_count+1)] (compressed start, uncompressed start, first element) of every block and of the end
+//   compressed blocks
+// Blocks hold whole lines, at most DATASET_BLOCK_SIZE bytes and DATASET_BLOCK_MAX_LINES of them, and are compressed
+// independently. The line ends are not stored, they are found again whenever a block is decompressed.
+// The unterminated tail of the text is not part of any element and is dropped.
+bool write_builtin_dataset_blob(BuiltinDatasetAsset* asset, bool* out_changed) {
+    bool ok = false;
+    Nob_String_Builder text = {0}, compressed = {0}, blob = {0};
+    Uint32s block_offsets = {0};
+
+    if (!nob_read_entire_file(asset->text_path, &text)) goto defer;
+    if (text.count > UINT32_MAX) {
+        nob_log(NOB_ERROR, "%s: Built-in datasets must be smaller than 4 GiB", asset->text_path);
+        goto defer;
+    }
+
+    size_t block_start = 0, block_first_element = 0, line_start = 0, elements_count = 0, longest_element_len = 0;
+    for (size_t i = 0; i < text.count; ++i) {
+        if (text.items[i] != '\n') continue;
+
+        if (i + 1 - line_start > DATASET_BLOCK_SIZE) {
+            nob_log(NOB_ERROR, "%s: Line %zu is longer than %d bytes", asset->text_path, elements_count + 1, DATASET_BLOCK_SIZE);
+            goto defer;
+        }
+        if (i + 1 - block_start > DATASET_BLOCK_SIZE || elements_count - block_first_element == DATASET_BLOCK_MAX_LINES) {
+            append_dataset_block(&block_offsets, &compressed, text.items, block_start, line_start, block_first_element);
+            block_start = line_start;
+            block_first_element = elements_count;
+        }
+
+        if (i - line_start > longest_element_len) longest_element_len = i - line_start;
+        elements_count++;
+        line_start = i + 1;
+    }
+    if (line_start > block_start) {
+        append_dataset_block(&block_offsets, &compressed, text.items, block_start, line_start, block_first_element);
+    }
+    nob_da_append(&block_offsets, (uint32_t) compressed.count);
+    nob_da_append(&block_offsets, (uint32_t) line_start);
+    nob_da_append(&block_offsets, (uint32_t) elements_count);
+
+    asset->elements_count = elements_count;
+    asset->longest_element_len = longest_element_len;
+    asset->blocks_count = block_offsets.count / 3 - 1;
+    asset->size = line_start;
+
+    // the blob format and the compressor both live in this file
+    const char* blob_inputs[] = { asset->text_path, "nob.c", "include/dataset.h" };
+
+    *out_changed = false;
+    ok = true;
+    if (nob_needs_rebuild(asset->blob_path, blob_inputs, NOB_ARRAY_LEN(blob_inputs)) != 0) {
+        nob_sb_append_buf(&blob, (const char*) block_offsets.items, block_offsets.count * sizeof(uint32_t));
+        nob_sb_append_buf(&blob, compressed.items, compressed.count);
+
+        ok = nob_write_entire_file(asset->blob_path, blob.items, blob.count);
+        *out_changed = true;
+        nob_log(NOB_INFO, "Compressed %s: %zu -> %zu bytes", asset->text_path, asset->size, blob.count);
+    }
+
+defer:
+    nob_da_free(block_offsets);
+    nob_sb_free(blob);
+    nob_sb_free(compressed);
+    nob_sb_free(text);
+    return ok;
+}
+
+// Turns every assets/builtin-datasets/<name>.txt into a blob with its block table and compressed text
+// and generates the C source that embeds the blobs and defines the built-in datasets registry.
+int generate_builtin_datasets(const char* out_source_path) {
+    nob_mkdir_if_not_exists(GENERATED_DIR);
+
+    Nob_File_Paths entries = {0};
+    if (!nob_read_entire_dir(BUILTIN_DATASETS_DIR, &entries)) return 1;
+    qsort(entries.items, entries.count, sizeof(entries.items[0]), compare_cstrs);
+
+    BuiltinDatasetAssets assets = {0};
+    bool any_blob_changed = false;
+    for (size_t i = 0; i < entries.count; ++i) {
+        const char* file_name = entries.items[i];
+        size_t len = strlen(file_name);
+        if (len <= 4 || strcmp(file_name + len - 4, ".txt") != 0) continue;
+
+        char* name = nob_temp_strndup(file_name, len - 4);
+        char* ident = nob_temp_strdup(name);
+        for (char* c = ident; *c; ++c) {
+            if (!isalnum((unsigned char) *c)) *c = '_';
+        }
+
+        BuiltinDatasetAsset asset = {
+            .name = name,
+            .ident = ident,
+            .text_path = nob_temp_sprintf("%s/%s", BUILTIN_DATASETS_DIR, file_name),
+            .blob_path = nob_temp_sprintf("%s%s.blob", GENERATED_DIR, name),
+        };
+
+        bool changed;
+        if (!write_builtin_dataset_blob(&asset, &changed)) {
+            nob_log(NOB_ERROR, "Failed to generate %s", asset.blob_path);
+            return 1;
+        }
+        any_blob_changed = any_blob_changed || changed;
+        nob_da_append(&assets, asset);
+    }
+    nob_da_free(entries);
+
+    Nob_String_Builder source = {0};
+    nob_sb_append_cstr(&source, "// Generated by nob.c from " BUILTIN_DATASETS_DIR ", do not edit.\n");
+    nob_sb_append_cstr(&source, "#include \"builtin-datasets.h\"\n\n");
+    nob_da_foreach(BuiltinDatasetAsset, asset, &assets) {
+        nob_sb_appendf(&source, "INCBIN(uint32_t, %s, \"%s\");\n", asset->ident, asset->blob_path);
+    }
+    nob_sb_appendf(&source, "\nconst BuiltinDatasetEntry builtin_datasets[] = {\n");
+    nob_da_foreach(BuiltinDatasetAsset, asset, &assets) {
+        nob_sb_appendf(&source,
+            "    {\n"
+            "        .name = { .data = \"%s\", .len = %zu },\n"
+            "        .blocks = {\n"
+            "            .offsets = embed_%s_data,\n"
+            "            .blocks_count = %zu,\n"
+            "            .longest_element_len = %zu,\n"
+            "            .data = (const unsigned char*) (embed_%s_data + %zu),\n"
+            "        },\n"
+            "    },\n",
+            asset->name, strlen(asset->name),
+            asset->ident,
+            asset->blocks_count,
+            asset->longest_element_len,
+            asset->ident, 3 * (asset->blocks_count + 1));
+    }
+    nob_sb_appendf(&source, "};\n\nconst size_t builtin_datasets_count = %zu;\n", assets.count);
+    nob_da_free(assets);
+
+    // incbin pulls the blobs in at assembly time, so the source has to be touched whenever one of them changes
+    Nob_String_Builder previous = {0};
+    bool unchanged = !any_blob_changed
+        && nob_file_exists(out_source_path) == 1
+        && nob_read_entire_file(out_source_path, &previous)
+        && previous.count == source.count
+        && memcmp(previous.items, source.items, source.count) == 0;
+    nob_sb_free(previous);
+
+    bool ok = unchanged || nob_write_entire_file(out_source_path, source.items, source.count);
+    nob_sb_free(source);
+    return ok ? 0 : 1;
+}
+
+// Compiles every source file of `dir` into `objects`, programs other than tpv get their directory as a prefix
+int compile_dir(BuildCmdOptions* opts, Flags* compile_flags, const char* dir, Nob_File_Paths* objects) {
     Nob_File_Paths sources = {0};
-    read_entire_dir_recursive("src", &sources, strlen("src"));
+    read_entire_dir_recursive(dir, &sources, strlen(dir));
 
     char object_files_dir[PATH_MAX];
     snprintf(
@@ -209,15 +475,16 @@ int build(BuildCmdOptions* opts) {
         "%s/build/%s", get_project_root(), get_build_subdir_name(opts));
     nob_mkdir_if_not_exists(object_files_dir);
 
-    Nob_File_Paths objects = {0};
-
     for (size_t i = 0; i < sources.count; ++i) {
         char source_path[PATH_MAX];
-        snprintf(source_path, sizeof source_path, "./src/%s", sources.items[i]);
+        snprintf(source_path, sizeof source_path, "./%s/%s", dir, sources.items[i]);
 
         char path_normalized[PATH_MAX];
-        strncpy(path_normalized, sources.items[i], sizeof path_normalized);
-        path_normalized[sizeof(path_normalized) - 1] = '\0';
+        if (strcmp(dir, "src") == 0) {
+            snprintf(path_normalized, sizeof path_normalized, "%s", sources.items[i]);
+        } else {
+            snprintf(path_normalized, sizeof path_normalized, "%s/%s", dir, sources.items[i]);
+        }
         
         int len = strlen(path_normalized);
         if (len > 2 && strcmp(path_normalized + len - 2, ".c") == 0) {
@@ -233,38 +500,54 @@ int build(BuildCmdOptions* opts) {
 
         if (!needs_rebuild(source_path, out_obj_path)) {
             nob_log(NOB_INFO, "Skipping %s.c (up to date)", path_normalized);
-            nob_da_append(&objects, out_obj_path);
+            nob_da_append(objects, out_obj_path);
             continue;
         }
 
-        Nob_Cmd cc = {0};
-        nob_cc(&cc);
-        nob_cmd_extend(&cc, &compile_flags);
-        nob_cmd_append(&cc, "-Wall", "-Wextra");
-        if (opts->mode == Release) {
-            nob_cmd_append(&cc, "-O3", "-flto", "-DNDEBUG");
-        } else if (opts->mode == Debug) {
-            nob_cmd_append(&cc, "-O0", "-g");
-        }
-        if (opts->use_asan) {
-            nob_cmd_append(&cc, "-fsanitize=address");
-        }
-        if (opts->use_ubsan) {
-            nob_cmd_append(&cc, "-fsanitize=undefined");
-        }
-        nob_cmd_append(&cc, source_path, "-c", "-o", out_obj_path);
-
-        if (!nob_cmd_run(&cc, .async = false)) {
+        if (compile_object(opts, compile_flags, source_path, out_obj_path) != 0) {
             nob_log(NOB_ERROR, "Failed to compile %s.c", path_normalized);
-            nob_cmd_free(cc);
             return 1;
         }
 
-        nob_cmd_free(cc);
-        nob_da_append(&objects, out_obj_path);
+        nob_da_append(objects, out_obj_path);
+    }
+
+    return 0;
+}
+
+// Compiles src/ and the built-in datasets, everything the tpv executable is linked from
+int compile_tpv_objects(BuildCmdOptions* opts, Flags* compile_flags, Flags* link_flags, Nob_File_Paths* objects) {
+    chdir_to_project_root();
+    nob_mkdir_if_not_exists(BUILD_DIR);
+    nob_mkdir_if_not_exists(OUT_DIR);
+
+    build_external_libs(compile_flags, link_flags);
+
+    nob_da_append(compile_flags, "-Iinclude");
+    nob_da_append(compile_flags, "-Iexternal");
+    nob_da_append(compile_flags, "-pthread");
+    nob_da_append(link_flags, "-pthread");
+
+    chdir_to_project_root();
+    CHECK(compile_dir(opts, compile_flags, "src", objects));
+
+    const char* builtin_datasets_source = GENERATED_DIR "builtin-datasets.c";
+    if (generate_builtin_datasets(builtin_datasets_source) != 0) {
+        nob_log(NOB_ERROR, "Failed to generate built-in datasets");
+        return 1;
     }
-    nob_da_free(compile_flags);
 
+    char* builtin_datasets_obj = nob_temp_sprintf("%s/build/%s/generated_builtin-datasets.o", get_project_root(), get_build_subdir_name(opts));
+    if (needs_rebuild(builtin_datasets_source, builtin_datasets_obj)
+            && compile_object(opts, compile_flags, builtin_datasets_source, builtin_datasets_obj) != 0) {
+        nob_log(NOB_ERROR, "Failed to compile %s", builtin_datasets_source);
+        return 1;
+    }
+    nob_da_append(objects, builtin_datasets_obj);
+    return 0;
+}
+
+int link_executable(BuildCmdOptions* opts, Flags* link_flags, Nob_File_Paths* objects, const char* out) {
     Nob_Cmd link = {0};
     nob_cc(&link);
     if (opts->mode == Release) {
@@ -277,24 +560,77 @@ int build(BuildCmdOptions* opts) {
         nob_cmd_append(&link, "-fsanitize=undefined");
     }
 
-    const char* out = get_output_bin_name(opts);
-
-    nob_cmd_extend(&link, &objects);
-    nob_cmd_extend(&link, &link_flags);
+    nob_cmd_extend(&link, objects);
+    nob_cmd_extend(&link, link_flags);
     nob_cmd_append(&link, "-o", out);
 
-    nob_da_free(link_flags);
-    if (!nob_cmd_run(&link, .async = false)) {
+    bool ok = nob_cmd_run(&link, .async = false);
+    nob_cmd_free(link);
+    if (!ok) {
         nob_log(NOB_ERROR, "Failed to link executable %s.", out);
-        nob_cmd_free(link);
         return 1;
     }
+    return 0;
+}
+
+int build(BuildCmdOptions* opts) {
+    Flags compile_flags = {0}, link_flags = {0};
+    Nob_File_Paths objects = {0};
+    CHECK(compile_tpv_objects(opts, &compile_flags, &link_flags, &objects));
+    nob_da_free(compile_flags);
+
+    CHECK(link_executable(opts, &link_flags, &objects, get_output_bin_name(opts)));
+    nob_da_free(link_flags);
 
-    nob_cmd_free(link);
     nob_log(NOB_INFO, "TPV compiled and linked successfully");
     return 0;
 }
 
+// Builds every source of `dir` into its own executable, linked against everything but src/main.c, and runs
+// them one after another. Fails as soon as one of them does.
+int build_and_run_programs(BuildCmdOptions* opts, const char* dir) {
+    Flags compile_flags = {0}, link_flags = {0};
+    Nob_File_Paths tpv_objects = {0};
+    CHECK(compile_tpv_objects(opts, &compile_flags, &link_flags, &tpv_objects));
+
+    Nob_File_Paths library_objects = {0};
+    for (size_t i = 0; i < tpv_objects.count; ++i) {
+        const char* obj = tpv_objects.items[i];
+        size_t len = strlen(obj);
+        if (len >= strlen("/main.o") && strcmp(obj + len - strlen("/main.o"), "/main.o") == 0) continue;
+        nob_da_append(&library_objects, obj);
+    }
+
+    Nob_File_Paths program_objects = {0};
+    CHECK(compile_dir(opts, &compile_flags, dir, &program_objects));
+    nob_da_free(compile_flags);
+
+    for (size_t i = 0; i < program_objects.count; ++i) {
+        const char* obj = program_objects.items[i];
+        const char* name = strrchr(obj, '/') + 1;
+        const char* out = nob_temp_sprintf(OUT_DIR "%.*s-%s.elf", (int) (strlen(name) - 2), name, get_build_subdir_name(opts));
+
+        Nob_File_Paths objects = {0};
+        nob_da_append_many(&objects, library_objects.items, library_objects.count);
+        nob_da_append(&objects, obj);
+        int linked = link_executable(opts, &link_flags, &objects, out);
+        nob_da_free(objects);
+        CHECK(linked);
+
+        Nob_Cmd run = {0};
+        nob_cmd_append(&run, out);
+        bool ok = nob_cmd_run(&run, .async = false);
+        nob_cmd_free(run);
+        if (!ok) {
+            nob_log(NOB_ERROR, "%s failed", out);
+            return 1;
+        }
+    }
+
+    nob_da_free(link_flags);
+    return 0;
+}
+
 int clean(CleanCmdOptions* opts) {
     chdir_to_project_root();
     if (!delete_dir("build")) return 1;
@@ -343,6 +679,16 @@ int install(InstallCmdOptions* opts) {
     return 0;
 }
 
+int bench(BenchCmdOptions* opts) {
+    // numbers of a debug build mean nothing
+    opts->build_options.mode = Release;
+    return build_and_run_programs(&opts->build_options, "bench");
+}
+
+int test(TestCmdOptions* opts) {
+    return build_and_run_programs(&opts->build_options, "tests");
+}
+
 char* shift(int* argc, char*** argv) {
     if (*argc == 0)
         return NULL;
@@ -373,7 +719,9 @@ bool implies_build_command(const char* command) {
      || strcmp(command, "rebuild")     == 0
      || strcmp(command, "run")         == 0
      || strcmp(command, "rebuild-run") == 0
-     || strcmp(command, "install")     == 0;
+     || strcmp(command, "install")     == 0
+     || strcmp(command, "bench")       == 0
+     || strcmp(command, "test")        == 0;
 }
 
 int main(int argc, char** argv) {
@@ -393,7 +741,9 @@ int main(int argc, char** argv) {
                 || strcmp(opt, "clean")       == 0
                 || strcmp(opt, "run")         == 0
                 || strcmp(opt, "rebuild-run") == 0
-                || strcmp(opt, "install")     == 0;
+                || strcmp(opt, "install")     == 0
+                || strcmp(opt, "bench")       == 0
+                || strcmp(opt, "test")        == 0;
 
             if (command != NULL) {
                 nob_log(NOB_ERROR, "Unexpected argument: %s", opt);
@@ -458,6 +808,10 @@ int main(int argc, char** argv) {
         return clean(&cmd_options.clean);
     } else if (strcmp(command, "install") == 0) {
         return install(&cmd_options.install);
+    } else if (strcmp(command, "bench") == 0) {
+        return bench(&cmd_options.bench);
+    } else if (strcmp(command, "test") == 0) {
+        return test(&cmd_options.test);
     } else {
         nob_log(NOB_ERROR, "Unknown command: %s.", command);
         return 1;
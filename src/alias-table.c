@@ -0,0 +1,73 @@
+#include "alias-table.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+static inline double sanitized_weight(double weight) {
+    return isfinite(weight) && weight > 0.0 ? weight : 0.0;
+}
+
+bool build_alias_table(AliasTable* table, double* weights, size_t count) {
+    if (count == 0 || count > UINT32_MAX) return false;
+
+    double weights_sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        weights_sum += sanitized_weight(weights[i]);
+    }
+    if (!(weights_sum > 0.0) || !isfinite(weights_sum)) return false;
+
+    uint32_t* thresholds = malloc(count * sizeof(uint32_t));
+    uint32_t* aliases = malloc(count * sizeof(uint32_t));
+    double* scaled = weights;
+    // small columns are pushed from the front, large ones from the back
+    uint32_t* worklist = malloc(count * sizeof(uint32_t));
+    if (thresholds == NULL || aliases == NULL || worklist == NULL) goto e1;
+
+    size_t small_count = 0, large_start = count;
+    for (size_t i = 0; i < count; ++i) {
+        scaled[i] = sanitized_weight(weights[i]) * (double) count / weights_sum;
+        if (scaled[i] < 1.0) worklist[small_count++] = (uint32_t) i;
+        else                 worklist[--large_start] = (uint32_t) i;
+    }
+
+    while (small_count > 0 && large_start < count) {
+        uint32_t small = worklist[--small_count];
+        uint32_t large = worklist[large_start];
+
+        thresholds[small] = (uint32_t) (scaled[small] * 4294967296.0);
+        aliases[small] = large;
+
+        scaled[large] -= 1.0 - scaled[small];
+        if (scaled[large] < 1.0) {
+            large_start++;
+            worklist[small_count++] = large;
+        }
+    }
+
+    // whatever is left is full up to rounding errors, and aliases itself just in case
+    while (small_count > 0) {
+        uint32_t i = worklist[--small_count];
+        thresholds[i] = UINT32_MAX;
+        aliases[i] = i;
+    }
+    for (size_t j = large_start; j < count; ++j) {
+        uint32_t i = worklist[j];
+        thresholds[i] = UINT32_MAX;
+        aliases[i] = i;
+    }
+
+    free(worklist);
+    *table = (AliasTable) { .thresholds = thresholds, .aliases = aliases, .count = count };
+    return true;
+
+e1: free(thresholds);
+    free(aliases);
+    free(worklist);
+    return false;
+}
+
+void free_alias_table(AliasTable* table) {
+    free(table->thresholds);
+    free(table->aliases);
+    *table = ALIAS_TABLE_NULL;
+}
@@ -1,20 +1,37 @@
 #include "app.h"
 
-#include "diff.h"     // for print_diff
+#include "diff.h"     // for diff_edit_script, diff_edit_script_by_tokens, render_diff, diff_count_mistakes
 #include "sv.h"       // for StringView
 #include "ansi.h"     // for GREEN, RED, BOLD, RESET
 #include "messages.h" // for tpv_get_random_praise, tpv_get_random_retry_message, tpv_get_random_goodbye_message
 #include "timespan.h" // for TimeSpanSec, now
 #include "cli-args.h" // for CliArgs, parse_cli_args, free_cli_args
 
-#include "datasets-utils.h" // for random_element
+#include "datasets-utils.h" // for DataSetsSampler, init_datasets_sampler
+#include "prompt-queue.h"   // for PromptQueue, Prompt, prompt_queue_next
+#include "rng.h"            // for rng_from_seed
+#include "terminal-input.h" // for TerminalInput, KeyEvent, terminal_read_key
+#include "live-match.h"     // for LiveMatch, live_match_push, live_match_pop
+#include "input-compare.h"  // for InputComparator, input_comparator
 
 #include <stddef.h>   // for size_t
-#include <stdio.h>    // for printf, puts, fputs
+#include <inttypes.h> // for PRIu64
+#include <stdio.h>    // for printf, puts, fputs, fwrite
 #include <stdlib.h>   // for malloc, free
 #include <string.h>   // for memcpy
-#include <unistd.h>   // for sleep
-#include <ctype.h>    // for ispunct, tolower
+#include <unistd.h>   // for sleep, getpid, STDIN_FILENO
+
+static bool tpv_no_repeat(CliArgs* args) {
+    return (args->repeat.set && !args->repeat.value) || args->no_repeat_from.set;
+}
+
+static bool tpv_ignore_case(CliArgs* args) {
+    return !args->ignore_case.set || args->ignore_case.value;
+}
+
+static bool tpv_ignore_punctuations(CliArgs* args) {
+    return args->ignore_punctuations.set && args->ignore_punctuations.value;
+}
 
 TpvApp tpv_init(int argc, char** argv) {
     TpvApp app = {0};
@@ -23,72 +40,251 @@ TpvApp tpv_init(int argc, char** argv) {
         exit(1);
     }
 
+    bool no_repeat = tpv_no_repeat(&app.args);
+
+    // a seeded session must not depend on how far the background indexing got,
+    // and a no-repeat order is only defined over the full datasets
+    if (app.args.seed.set || no_repeat) {
+        for (size_t i = 0; i < app.args.datasets_count; ++i) {
+            dataset_wait_index(&app.args.datasets[i]);
+        }
+    }
+
+    if (app.args.seed.set) {
+        app.seed = app.args.seed.value;
+    } else {
+        uint64_t entropy = ((uint64_t) time(NULL) << 20) ^ (uint64_t) getpid();
+        app.seed = splitmix64(&entropy);
+    }
+    app.rng = rng_from_seed(app.seed);
+    app.messages_rng = rng_from_seed(~app.seed);
+    for (size_t i = 0; i < app.args.generator_datasets_count; ++i) {
+        seed_generator_dataset(&app.args.generator_datasets[i], app.seed + 0x9e3779b97f4a7c15ull * (i + 1));
+    }
+
     return app;
 }
 
+// The sampler points into `app->args`, so it is only built once the app sits at its final address
+static bool tpv_init_sampler(TpvApp* app) {
+    CliArgs* args = &app->args;
+    app->sampler = init_datasets_sampler(args->datasets, args->dataset_weights, args->datasets_count,
+                                         args->generator_datasets, args->generator_dataset_weights, args->generator_datasets_count,
+                                         0.3);
+    if (datasets_sampler_is_null(&app->sampler)) return false;
+
+    uint64_t no_repeat_from = args->no_repeat_from.set ? args->no_repeat_from.value : 0;
+    if (tpv_no_repeat(args) && !datasets_sampler_enable_no_repeat(&app->sampler, app->seed, no_repeat_from)) {
+        return false;
+    }
+
+    return true;
+}
+
+// A prompt still being indexed may turn out longer, buffers sized from it grow then
+static size_t tpv_longest_prompt_len(TpvApp* app) {
+    CliArgs* args = &app->args;
+    size_t longest = args->generator_datasets_count > 0 ? GENERATOR_DATASET_MAX_LEN : 0;
+    for (size_t i = 0; i < args->datasets_count; ++i) {
+        size_t len = dataset_longest_element_len(&args->datasets[i]);
+        if (len > longest) longest = len;
+    }
+    return longest;
+}
+
+static bool tpv_init_line_buf(TpvApp* app, size_t longest_prompt_len) {
+    app->line_cap = longest_prompt_len + LINE_INPUT_BUF_SLACK;
+    app->line_buf = malloc(app->line_cap);
+    return app->line_buf != NULL;
+}
+
+static bool tpv_init_key_events(TpvApp* app) {
+    app->key_events = (KeyEvents) { .events = malloc(KEY_EVENTS_CAPACITY * sizeof(KeyEvent)) };
+    return app->key_events.events != NULL;
+}
+
 void tpv_free(TpvApp* app) {
+    free(app->key_events.events);
+    free(app->line_buf);
+    free_datasets_sampler(&app->sampler);
     free_cli_args(&app->args);
 }
 
 void tpv_run(TpvApp* app) {
-    srand(time(NULL));
+    size_t longest_prompt_len = tpv_longest_prompt_len(app);
+    if (!tpv_init_sampler(app) || !tpv_init_line_buf(app, longest_prompt_len) || !tpv_init_key_events(app)) {
+        puts("Could not set up the prompt selection.");
+        return;
+    }
+
+    app->comparator = input_comparator(tpv_ignore_case(&app->args), tpv_ignore_punctuations(&app->args));
 
+    // the first prompts get drawn during the welcome countdown
+    if (!init_prompt_queue(&app->prompts, &app->sampler, &app->rng, app->comparator, longest_prompt_len)) {
+        puts("Could not start the prompt queue.");
+        return;
+    }
 
+    terminal_input_enable_raw(&app->terminal, STDIN_FILENO);
     app->running = true;
 
     tpv_show_welcome(app);
     while (app->running) {
         tpv_handle_input(app);
     }
+    terminal_input_restore(&app->terminal);
+    free_prompt_queue(&app->prompts);
     tpv_show_goodbye(app);
 }
 
-TpvLine tpv_read_line(const char* prompt, StringView expected_input) {
-    TpvLine line = {0};
+// Only grows for lines longer than every prompt plus LINE_INPUT_BUF_SLACK, the extra input is dropped if that fails
+static bool tpv_line_push(TpvApp* app, TpvLine* line, char c) {
+    if (line->input_len == app->line_cap) {
+        size_t new_cap = app->line_cap * 2;
+        char* new_buf = realloc(app->line_buf, new_cap);
+        if (!new_buf) return false;
 
-    printf(BOLD "Type \"%.*s\"" RESET "\n", (int) expected_input.len, expected_input.data);
-    fputs(prompt, stdout);
+        app->line_buf = new_buf;
+        app->line_cap = new_cap;
+        line->input_buf = new_buf;
+    }
+    line->input_buf[line->input_len++] = c;
+    return true;
+}
+
+static const char* tpv_live_cell_color(LiveCell cell) {
+    switch (cell) {
+    case LIVE_CELL_CORRECT:   return GREEN;
+    case LIVE_CELL_INCORRECT: return RED;
+    default:                  return RESET;
+    }
+}
+
+// When the line is over a limit even if it were finished right now, 0 without limits.
+// The per-character limit allows typing the whole prompt at exactly that pace.
+static uint64_t tpv_line_deadline_ns(CliArgs* args, StringView expected, uint64_t start_ns) {
+    TimeSpanSec allowed = -1.0;
+    if (args->time_limit.set) {
+        allowed = args->time_limit.value;
+    }
+    if (args->time_per_char_limit.set) {
+        TimeSpanSec allowed_by_pace = args->time_per_char_limit.value * (TimeSpanSec) (expected.len > 0 ? expected.len : 1);
+        if (allowed < 0.0 || allowed_by_pace < allowed) allowed = allowed_by_pace;
+    }
+
+    return allowed < 0.0 ? 0 : start_ns + (uint64_t) (allowed * 1e9) + 1;
+}
+
+// Reads key by key, echoing the edits, every keystroke lands in `app->key_events`.
+// With `live` every typed character is echoed coloured by how it compares against the prompt.
+// A line not entered before its time limits run out ends right there, with `timed_out` set.
+static TpvLine tpv_read_raw_line(TpvApp* app, StringView expected, LiveMatch* live) {
+    TpvLine line = { .input_buf = app->line_buf };
+    // the colour only changes between whole characters, escapes inside a UTF-8 sequence would break it
+    LiveCell shown_cell = LIVE_CELL_IGNORED;
+    app->key_events.count = 0;
+    app->key_events.dropped_count = 0;
+
+    uint64_t start_ns = now_ns(), end_ns = start_ns;
+    terminal_input_set_deadline(&app->terminal, tpv_line_deadline_ns(&app->args, expected, start_ns));
+    KeyEvent event;
+    while (true) {
+        if (!terminal_read_key(&app->terminal, &event)) {
+            line.interrupted = true;
+            break;
+        }
+        // keys typed ahead, during the countdown or before this prompt was drawn, waited in the ring
+        // with their own stamps, the line then starts with the first of them
+        if (app->key_events.count == 0 && app->key_events.dropped_count == 0 && event.time_ns < start_ns) {
+            start_ns = event.time_ns;
+            terminal_input_set_deadline(&app->terminal, tpv_line_deadline_ns(&app->args, expected, start_ns));
+        }
+        key_events_push(&app->key_events, event);
 
-    TimeSpanSec start, end;
-    start = now(); {
-        char c;
-        while ((c = getchar()) != '\n') {
-            if (line.input_len == line.input_cap) {
-                size_t new_cap = line.input_cap == 0
-                    ? LINE_INPUT_BUF_INITIAL_CAPACITY
-                    : line.input_cap * 2;
-            
-                char* new_buf = realloc(line.input_buf, new_cap);
-                if (!new_buf) {
-                    free(line.input_buf);
-                    return TPV_LINE_NULL;
+        if (event.kind == KEY_EVENT_ENTER) {
+            end_ns = event.time_ns;
+            fputs(RESET "\n", stdout);
+            break;
+        } else if (event.kind == KEY_EVENT_INTERRUPT) {
+            line.interrupted = true;
+            fputs(RESET "\n", stdout);
+            break;
+        } else if (event.kind == KEY_EVENT_DEADLINE) {
+            line.timed_out = true;
+            end_ns = event.time_ns;
+            fputs(RESET "\n", stdout);
+            break;
+        } else if (event.kind == KEY_EVENT_ERASE) {
+            // drop a whole UTF-8 sequence
+            while (line.input_len > 0) {
+                char c = line.input_buf[--line.input_len];
+                if (live) live_match_pop(live, c);
+                if (((unsigned char) c & 0xc0) != 0x80) {
+                    fputs("\b \b", stdout);
+                    break;
                 }
-            
-                line.input_buf = new_buf;
-                line.input_cap = new_cap;
             }
-            line.input_buf[line.input_len++] = c;
+        } else if (event.kind == KEY_EVENT_CHAR) {
+            if (!tpv_line_push(app, &line, event.byte)) continue;
+
+            if (live) {
+                LiveCell cell = live_match_push(live, event.byte);
+                if (((unsigned char) event.byte & 0xc0) != 0x80 && cell != shown_cell) {
+                    fputs(tpv_live_cell_color(cell), stdout);
+                    shown_cell = cell;
+                }
+            }
+            putchar(event.byte);
         }
-    } end = now();
+        fflush(stdout);
+    }
 
-    line.typing_time = end - start;
-    line.typing_time_per_char = line.typing_time / line.input_len;
+    terminal_input_set_deadline(&app->terminal, 0);
+    line.typing_time = end_ns > start_ns ? (TimeSpanSec) (end_ns - start_ns) / 1e9 : 0.0;
     return line;
 }
 
-void tpv_free_line(TpvLine* line) {
-    free(line->input_buf);
+TpvLine tpv_read_line(TpvApp* app, const char* prompt, const Prompt* expected_input) {
+    fwrite(expected_input->render.data, 1, expected_input->render.len, stdout);
+    fputs(prompt, stdout);
+
+    TpvLine line;
+    if (app->terminal.raw) {
+        fflush(stdout);
+        CliArgs* args = &app->args;
+        LiveMatch live = live_match_start(expected_input->text, tpv_ignore_case(args), tpv_ignore_punctuations(args));
+        line = tpv_read_raw_line(app, expected_input->text, args->live.set && args->live.value ? &live : NULL);
+    } else {
+        line = (TpvLine) { .input_buf = app->line_buf };
+
+        TimeSpanSec start, end;
+        start = now(); {
+            int c;
+            while ((c = getchar()) != '\n') {
+                if (c == EOF) {
+                    line.interrupted = line.input_len == 0;
+                    break;
+                }
+                tpv_line_push(app, &line, (char) c);
+            }
+        } end = now();
+
+        line.typing_time = end - start;
+    }
+
+    // an empty line, e.g. one that timed out, took its whole time for a single character
+    line.typing_time_per_char = line.input_len > 0 ? line.typing_time / line.input_len : line.typing_time;
+    return line;
 }
 
 void tpv_show_welcome(TpvApp* app) {
-    (void) app;
-
     puts(BOLD "Welcome to TPV!" RESET);
     puts(BOLD "TPV" RESET " is a game that involves typing words, sentences, or other texts without mistakes " BOLD "against the clock 🕰️!" RESET);
     puts("So what are you waiting for? " BOLD "Learn to type fast!" RESET);
     puts("");
     puts("You will be shown various texts. Your task is to transcribe them as quickly as possible."
             " If you want to leave, type " BOLD "/quit" RESET " or " BOLD "/exit" RESET "!");
+    printf("Session seed: " BOLD "%" PRIu64 RESET " (pass " BOLD "--seed=%" PRIu64 RESET " to replay this session)\n", app->seed, app->seed);
 
     for (int i = 3; i > 0; --i) {
         printf(BOLD "%d..." RESET "\n", i);
@@ -105,7 +301,12 @@ void tpv_show_goodbye(TpvApp* app) {
         tpv_show_stats(app, "    ");
 
         puts("");
-        puts(tpv_get_random_goodbye_message());
+        puts(tpv_get_random_goodbye_message(&app->messages_rng));
+    }
+
+    if (app->sampler.no_repeat) {
+        printf("Pass " BOLD "--seed=%" PRIu64 " --no-repeat-from=%" PRIu64 RESET " to pick up where you left off.\n",
+                app->seed, app->no_repeat_resume_position);
     }
 }
 
@@ -127,112 +328,136 @@ void tpv_show_stats(TpvApp* app, const char* indent) {
     printf("%sAverage typing time per character:  " BOLD "%.1lf seconds" RESET "\n", indent, avg_typing_time_per_char);
     printf("%sCorrect to incorrect answers ratio: " BOLD GREEN "%zu" RESET BOLD "/" RESET BOLD RED "%zu" RESET BOLD " (" "%s%.0f%%" RESET ")" "\n",
                 indent, app->correct_count, app->incorrect_count, ratio_percent_color, correct_to_incorect_answers_ratio);
-}
 
-bool tpv_input_eql(StringView input, StringView expected, bool ignore_case, bool ignore_punctuations) {
-    if (!ignore_case && !ignore_punctuations)
-        return sv_eql(input, expected);
-
-    size_t i = 0, j = 0;
+    const DiffMistakes* mistakes = &app->mistakes;
+    if (mistakes->substituted + mistakes->missing + mistakes->extra > 0) {
+        printf("%sMistyped characters:                " BOLD "%zu" RESET " wrong, " BOLD "%zu" RESET " missing, " BOLD "%zu" RESET " extra\n",
+                indent, mistakes->substituted, mistakes->missing, mistakes->extra);
+    }
 
-    while (i < input.len && j < expected.len) {
-        char a = input.data[i];
-        char b = expected.data[j];
+    if (app->key_intervals_count > 0) {
+        printf("%sAverage time between keys:          " BOLD "%.0lf ms" RESET "\n", indent, app->key_intervals_sum / app->key_intervals_count * 1e3);
+        printf("%sLongest hesitation:                 " BOLD "%.1lf seconds" RESET "\n", indent, app->longest_hesitation);
+        printf("%sErased characters:                  " BOLD "%zu" RESET "\n", indent, app->erased_count);
+    }
+}
 
-        if (ignore_punctuations && ispunct((unsigned char) a)) {
-            i++;
-            continue;
-        }
-        if (ignore_punctuations && ispunct((unsigned char) b)) {
-            j++;
-            continue;
-        }
+// The same edit script is rendered and counted into the mistake statistics
+static void tpv_show_diff(TpvApp* app, StringView expected, StringView input) {
+    bool word_diff = app->args.word_diff.set && app->args.word_diff.value;
+    DiffEditScript script = word_diff ? diff_edit_script_by_tokens(expected, input) : diff_edit_script(expected, input);
+    if (diff_edit_script_is_null(&script)) {
+        putchar('\n');
+        return;
+    }
 
-        if (ignore_case) {
-            a = (char) tolower((unsigned char) a);
-            b = (char) tolower((unsigned char) b);
-        }
+    render_diff(STDOUT_FILENO, expected, input, &script);
 
-        if (a != b)
-            return false;
+    DiffMistakes mistakes = diff_count_mistakes(&script);
+    app->mistakes.substituted += mistakes.substituted;
+    app->mistakes.missing += mistakes.missing;
+    app->mistakes.extra += mistakes.extra;
 
-        i++;
-        j++;
-    }
+    free_diff_edit_script(&script);
+}
 
-    if (ignore_punctuations) {
-        while (i < input.len && ispunct((unsigned char) input.data[i]))       i++;
-        while (j < expected.len && ispunct((unsigned char) expected.data[j])) j++;
+// Folds the keystrokes of the line just entered into the stats, pauses are measured between
+// whole characters, erases and Enter
+static void tpv_record_keystrokes(TpvApp* app) {
+    const KeyEvents* events = &app->key_events;
+    uint64_t prev_ns = 0;
+    for (size_t i = 0; i < events->count; ++i) {
+        const KeyEvent* event = &events->events[i];
+        if (event->kind == KEY_EVENT_ERASE) app->erased_count++;
+
+        bool is_key = event->kind == KEY_EVENT_ERASE || event->kind == KEY_EVENT_ENTER
+            || (event->kind == KEY_EVENT_CHAR && ((unsigned char) event->byte & 0xc0) != 0x80);
+        if (!is_key) continue;
+
+        if (prev_ns != 0 && event->time_ns > prev_ns) {
+            TimeSpanSec interval = (TimeSpanSec) (event->time_ns - prev_ns) / 1e9;
+            app->key_intervals_sum += interval;
+            app->key_intervals_count++;
+            if (interval > app->longest_hesitation) app->longest_hesitation = interval;
+        }
+        prev_ns = event->time_ns;
     }
-
-    return i == input.len && j == expected.len;
 }
 
 void tpv_handle_input(TpvApp* app) {
-    StringView text = random_element(app->args.datasets, app->args.datasets_count,
-                                     app->args.generator_datasets, app->args.generator_datasets_count,
-                                     0.3);
+    const Prompt* prompt = prompt_queue_next(&app->prompts);
+    app->no_repeat_resume_position = prompt->no_repeat_position;
+    StringView text = prompt->text;
 
     while (true) {
-        TpvLine line = tpv_read_line(BOLD ">>> " RESET, text);
+        TpvLine line = tpv_read_line(app, BOLD ">>> " RESET, prompt);
         StringView input = sv_from_data_and_len(line.input_buf, line.input_len);
 
-        if (sv_eql(input, SV("/quit")) || sv_eql(input, SV("/exit"))) {
+        // a command cut off by a time limit was never entered
+        bool is_command = !line.timed_out && sv_starts_with(input, SV("/"));
+
+        if (line.interrupted || (is_command && (sv_eql(input, SV("/quit")) || sv_eql(input, SV("/exit"))))) {
             app->running = false;
-            tpv_free_line(&line);
             return;
         }
-        if (sv_eql(input, SV("/stats"))) {
+        if (is_command && sv_eql(input, SV("/stats"))) {
             if (app->entered_items_count == 0) {
                 puts(BOLD "No stats to display." RESET);
-                tpv_free_line(&line);
                 continue;
             }
 
             puts(BOLD "Stats:" RESET);
             tpv_show_stats(app, "    ");
-            tpv_free_line(&line);
             continue;
         }
-        if (sv_starts_with(input, SV("/"))) {
+        if (is_command) {
             printf(BOLD RED "Unknown command '%.*s'\n" RESET, (int) input.len, input.data);
-            tpv_free_line(&line);
             continue;
         }
 
         app->entered_items_count++;
         app->typing_times_sum += line.typing_time;
         app->typing_times_per_char_sum += line.typing_time_per_char;
+        tpv_record_keystrokes(app);
 
-        bool ignore_case = !app->args.ignore_case.set || app->args.ignore_case.value;
-        bool ignore_punctuations = app->args.ignore_punctuations.set && app->args.ignore_punctuations.value;
+        CliArgs* args = &app->args;
+        bool over_time_limit = args->time_limit.set && line.typing_time > args->time_limit.value;
+        // a line cut off at the pace deadline may well be under the limit on average, being unfinished
+        bool over_time_per_char_limit = args->time_per_char_limit.set && (line.typing_time_per_char > args->time_per_char_limit.value || line.timed_out);
 
         bool is_correct = false;
+        bool is_game_over = false;
 
-        if (app->args.time_limit.set && line.typing_time > app->args.time_limit.value) {
+        if (over_time_limit) {
             is_correct = false;
+            is_game_over = args->game_over_on_exceed_time_limit.set && args->game_over_on_exceed_time_limit.value;
             printf(BOLD RED "%s" RESET " Exceeded time limit (%.2lfs > %.2lfs)\n",
-                    tpv_get_random_retry_message(), line.typing_time, app->args.time_limit.value);
-        } else if (app->args.time_per_char_limit.set && line.typing_time_per_char > app->args.time_per_char_limit.value) {
+                    tpv_get_random_retry_message(&app->messages_rng), line.typing_time, args->time_limit.value);
+        } else if (over_time_per_char_limit) {
             is_correct = false;
+            is_game_over = args->game_over_on_exceed_time_per_char_limit.set && args->game_over_on_exceed_time_per_char_limit.value;
             printf(BOLD RED "%s" RESET " Exceeded time limit per character (%.2lfs > %.2lfs per char)\n",
-                    tpv_get_random_retry_message(), line.typing_time, app->args.time_limit.value);
-        } else if (!tpv_input_eql(input, text, ignore_case, ignore_punctuations)) {
+                    tpv_get_random_retry_message(&app->messages_rng), line.typing_time_per_char, args->time_per_char_limit.value);
+        } else if (!app->comparator.eql(input, prompt->expected)) {
             is_correct = false;
-            printf(BOLD RED "%s" RESET " Look: ", tpv_get_random_retry_message());
-            print_diff(text, input);
+            is_game_over = args->game_over_on_mistake.set && args->game_over_on_mistake.value;
+            printf(BOLD RED "%s" RESET " Look: ", tpv_get_random_retry_message(&app->messages_rng));
+            tpv_show_diff(app, text, input);
         } else {
             is_correct = true;
-            printf(BOLD GREEN "%s" RESET " Typing time: %.2f\n", tpv_get_random_praise(), line.typing_time);
+            printf(BOLD GREEN "%s" RESET " Typing time: %.2f\n", tpv_get_random_praise(&app->messages_rng), line.typing_time);
         }
 
-        tpv_free_line(&line);
-
         if (is_correct) {
             app->correct_count++;
             break;
         } else {
             app->incorrect_count++;
+            if (is_game_over) {
+                puts(BOLD RED "Game over!" RESET);
+                app->running = false;
+                return;
+            }
             if (app->args.retry.set && app->args.retry.value) {
                 continue;
             } else {
@@ -0,0 +1,53 @@
+#include "block-compression.h"
+
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+
+static inline bool read_length_extension(const unsigned char* src, size_t src_len, size_t* io_ip, size_t* io_len) {
+    unsigned char b;
+    do {
+        if (*io_ip >= src_len) return false;
+        b = src[(*io_ip)++];
+        *io_len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool decompress_block(const unsigned char* src, size_t src_len, char* dst, size_t dst_len) {
+    size_t ip = 0, op = 0;
+
+    while (ip < src_len) {
+        unsigned char token = src[ip++];
+
+        size_t literals_len = token >> 4;
+        if (literals_len == 15 && !read_length_extension(src, src_len, &ip, &literals_len)) return false;
+        if (literals_len > src_len - ip || literals_len > dst_len - op) return false;
+
+        memcpy(dst + op, src + ip, literals_len);
+        ip += literals_len;
+        op += literals_len;
+
+        // the last sequence has literals only
+        if (ip == src_len) break;
+
+        if (src_len - ip < 2) return false;
+        size_t offset = (size_t) src[ip] | ((size_t) src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && !read_length_extension(src, src_len, &ip, &match_len)) return false;
+        match_len += LZ_MIN_MATCH;
+        if (match_len > dst_len - op) return false;
+
+        // byte by byte, matches may overlap their own output
+        const char* match = dst + op - offset;
+        for (size_t i = 0; i < match_len; ++i) {
+            dst[op + i] = match[i];
+        }
+        op += match_len;
+    }
+
+    return op == dst_len;
+}
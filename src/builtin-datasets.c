@@ -1,5 +0,0 @@
-#include "builtin-datasets.h"
-
-INCTXT(english_words, "assets/builtin-datasets/english-words.txt");
-INCTXT(english_sentences, "assets/builtin-datasets/english-sentences.txt");
-INCTXT(code_snippets, "assets/builtin-datasets/code-snippets.txt");
@@ -5,24 +5,17 @@
 #include "dataset.h"
 #include "builtin-datasets.h"
 #include "generator-dataset.h"
+#include "pattern-generator.h"
+#include "markov-generator.h"
 
 #include <assert.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
-
-typedef struct {
-    StringView name;
-    const char* data;
-    unsigned int size;
-} BuiltinDatasetEntry;
+#include <stdlib.h>
+#include <math.h>
 
 const BuiltinDatasetEntry* list_builtin_datasets(size_t* out_builtin_datasets_count) {
-    static BuiltinDatasetEntry builtin_datasets[3];
-    builtin_datasets[0] = (BuiltinDatasetEntry) { .name = SV("english-words"),     .data = embed_english_words_data,     .size = embed_english_words_size        };
-    builtin_datasets[1] = (BuiltinDatasetEntry) { .name = SV("english-sentences"), .data = embed_english_sentences_data, .size = embed_english_sentences_size    };
-    builtin_datasets[2] = (BuiltinDatasetEntry) { .name = SV("code-snippets"),     .data = embed_code_snippets_data,     .size = embed_code_snippets_size };
-    const size_t builtin_datasets_count = sizeof(builtin_datasets) / sizeof(builtin_datasets[0]);
-
     if (out_builtin_datasets_count)
         *out_builtin_datasets_count = builtin_datasets_count;
     return builtin_datasets;
@@ -55,7 +48,7 @@ DataSet load_builtin_dataset(StringView name) {
 
     for (size_t i = 0; i < builtin_datasets_count; ++i) {
         if (sv_eql(name, builtin_datasets[i].name)) {
-            return parse_dataset_from_str(sv_from_data_and_len(builtin_datasets[i].data, builtin_datasets[i].size));
+            return dataset_from_compressed_blocks(builtin_datasets[i].blocks);
         }
     }
 
@@ -113,6 +106,9 @@ bool cli_show_help() {
     puts("  -i, --ignore-case                               Ignore case when comparing characters.");
     puts("  -p, --ignore-punctuations                       Ignore punctuation characters during typing.");
     puts("  -r, --retry                                     Enable retry after failure.");
+    puts("  -l, --live                                      Highlight mistakes while typing.");
+    puts("  -w, --word-diff                                 Show mistakes word by word (token by token for code).");
+    puts("  --no-repeat                                     Show every prompt of the datasets once before any repeats.");
     puts("");
     puts("  --[no-]game-over-on-mistake                     End the game immediately after a mistake.");
     puts("  --[no-]game-over-on-exceed-time-limit           End the game if the total time limit is exceeded.");
@@ -122,12 +118,24 @@ bool cli_show_help() {
     puts("                                                  Examples: 1m, 30s, 2h10m.");
     puts("  --time-per-char-limit=<duration>                Set a per-character typing time limit.");
     puts("                                                  Examples: 500ms, 2s.");
+    puts("  --weight <dataset>=<weight>                     Scale how often a dataset is picked, 1 by default.");
+    puts("                                                  Examples: @code-snippets=3, words.txt=0.5.");
+    puts("  --markov-order=<k>                              Characters of context for @markov: datasets, 1 to 7 (default 3).");
+    puts("  --seed=<number>                                 Seed the random prompt selection to replay a session.");
+    puts("  --no-repeat-from=<position>                     Resume a --no-repeat session with the same seed.");
+    puts("  --index-threads=<count>                         Number of threads used to index large dataset files.");
+    puts("                                                  Defaults to the number of CPU cores.");
     puts("");
     puts(BOLD "Datasets:" RESET);
     puts("  Specify one or more datasets to use for typing practice.");
     puts("  You can pass a file path or a built-in dataset name prefixed with '@'.");
     puts("  Example: typer @english-words @code-snippets");
     puts("");
+    puts("  Prompts can also be generated from a pattern: @pattern:[a-z]{3,8}[0-9]{2} or @pattern:0x[0-9a-f]{8}.");
+    puts("  Patterns support [...] classes with ranges and [^...], '.', '\\' escapes and {n}, {n,m} and ? repetitions.");
+    puts("");
+    puts("  Pseudo-words following the letter statistics of any dataset: @markov:@english-words or @markov:words.txt.");
+    puts("");
     puts("  To list all built-in datasets, run: typer @unknown");
     puts("");
     puts(BOLD "Examples:" RESET);
@@ -148,18 +156,103 @@ bool set_cli_switch(StringView name, CliSwitch* cswitch, bool value) {
     return true;
 }
 
-bool cli_args_add_dataset(CliArgs* args, DataSet dataset) {
-    if (args->datasets_count == MAX_DATASETS) return false;
-    args->datasets[args->datasets_count++] = dataset;
+bool cli_args_add_dataset(CliArgs* args, DataSet dataset, StringView name) {
+    if (args->datasets_count == MAX_DATASETS) {
+        return cli_errorf("%.*s: Too many datasets, at most %d can be used at once.", (int) name.len, name.data, MAX_DATASETS);
+    }
+    args->datasets[args->datasets_count] = dataset;
+    args->dataset_names[args->datasets_count] = name;
+    args->dataset_weights[args->datasets_count] = 1.0;
+    args->datasets_count++;
     return true;
 }
 
-bool cli_args_add_generator_dataset(CliArgs* args, GeneratorDataset gd) {
-    if (args->generator_datasets_count == MAX_DATASETS) return false;
-    args->generator_datasets[args->generator_datasets_count++] = gd;
+bool cli_args_add_generator_dataset(CliArgs* args, GeneratorDataset gd, StringView name) {
+    if (args->generator_datasets_count == MAX_DATASETS) {
+        return cli_errorf("%.*s: Too many datasets, at most %d can be used at once.", (int) name.len, name.data, MAX_DATASETS);
+    }
+    args->generator_datasets[args->generator_datasets_count] = gd;
+    args->generator_dataset_names[args->generator_datasets_count] = name;
+    args->generator_dataset_weights[args->generator_datasets_count] = 1.0;
+    args->generator_datasets_count++;
     return true;
 }
 
+static bool parse_uint64(StringView str, uint64_t* out_value) {
+    if (str.len == 0) return false;
+
+    uint64_t value = 0;
+    for (size_t i = 0; i < str.len; ++i) {
+        char c = str.data[i];
+        if (c < '0' || c > '9') return false;
+        if (value > (UINT64_MAX - (uint64_t) (c - '0')) / 10) return false;
+        value = value * 10 + (uint64_t) (c - '0');
+    }
+
+    *out_value = value;
+    return true;
+}
+
+static bool parse_size(StringView str, size_t* out_size) {
+    uint64_t value;
+    if (!parse_uint64(str, &value) || value > SIZE_MAX) return false;
+
+    *out_size = (size_t) value;
+    return true;
+}
+
+bool parse_cli_weight(CliArgs* result, StringView spec) {
+    size_t eq = spec.len;
+    while (eq > 0 && spec.data[eq - 1] != '=') eq--;
+    if (eq <= 1) {
+        return cli_errorf("--weight: Expected <dataset>=<weight>, got '%.*s'", (int) spec.len, spec.data);
+    }
+
+    // the weight always ends the argv string, so strtod stops at its end
+    StringView value_string = sv_slice(spec, eq, spec.len);
+    char* end = NULL;
+    double value = value_string.len > 0 ? strtod(value_string.data, &end) : NAN;
+    if (end != value_string.data + value_string.len || !isfinite(value) || value < 0.0) {
+        return cli_errorf("--weight: Expected a non-negative number, got '%.*s'", (int) value_string.len, value_string.data);
+    }
+
+    if (result->weights_count == MAX_DATASETS) {
+        return cli_error("--weight: Too many weights");
+    }
+    result->weights[result->weights_count++] = (CliWeight) { .dataset_name = sv_slice(spec, 0, eq - 1), .value = value };
+    return true;
+}
+
+static bool apply_cli_weights(CliArgs* result) {
+    for (size_t i = 0; i < result->weights_count; ++i) {
+        CliWeight weight = result->weights[i];
+        bool matched = false;
+
+        for (size_t j = 0; j < result->datasets_count; ++j) {
+            if (!sv_eql(result->dataset_names[j], weight.dataset_name)) continue;
+            result->dataset_weights[j] = weight.value;
+            matched = true;
+        }
+        for (size_t j = 0; j < result->generator_datasets_count; ++j) {
+            if (!sv_eql(result->generator_dataset_names[j], weight.dataset_name)) continue;
+            result->generator_dataset_weights[j] = weight.value;
+            matched = true;
+        }
+
+        if (!matched) {
+            return cli_errorf("--weight: %.*s is not one of the datasets passed", (int) weight.dataset_name.len, weight.dataset_name.data);
+        }
+    }
+
+    for (size_t i = 0; i < result->datasets_count; ++i) {
+        if (result->dataset_weights[i] > 0.0) return true;
+    }
+    for (size_t i = 0; i < result->generator_datasets_count; ++i) {
+        if (result->generator_dataset_weights[i] > 0.0) return true;
+    }
+    return cli_error("--weight: At least one dataset needs a positive weight");
+}
+
 bool parse_cli_long_option(CliArgs* result, StringView arg) {
     assert(sv_starts_with(arg, SV("--")));
     StringView opt = sv_slice(arg, 2, arg.len);
@@ -184,6 +277,51 @@ bool parse_cli_long_option(CliArgs* result, StringView arg) {
         return true;
     }
 
+    StringView index_threads_string = sv_trim_prefix_or_null(opt, SV("index-threads="));
+    if (!sv_is_null(index_threads_string)) {
+        if (!parse_size(index_threads_string, &result->index_threads.value) || result->index_threads.value == 0) {
+            return cli_errorf("--index-threads: Expected a positive number, got '%.*s'", (int) index_threads_string.len, index_threads_string.data);
+        }
+
+        result->index_threads.set = true;
+        return true;
+    }
+
+    StringView markov_order_string = sv_trim_prefix_or_null(opt, SV("markov-order="));
+    if (!sv_is_null(markov_order_string)) {
+        if (!parse_size(markov_order_string, &result->markov_order.value) || result->markov_order.value == 0 || result->markov_order.value > MARKOV_MAX_ORDER) {
+            return cli_errorf("--markov-order: Expected a number from 1 to %d, got '%.*s'", MARKOV_MAX_ORDER, (int) markov_order_string.len, markov_order_string.data);
+        }
+
+        result->markov_order.set = true;
+        return true;
+    }
+
+    StringView weight_string = sv_trim_prefix_or_null(opt, SV("weight="));
+    if (!sv_is_null(weight_string)) {
+        return parse_cli_weight(result, weight_string);
+    }
+
+    StringView seed_string = sv_trim_prefix_or_null(opt, SV("seed="));
+    if (!sv_is_null(seed_string)) {
+        if (!parse_uint64(seed_string, &result->seed.value)) {
+            return cli_errorf("--seed: Expected a non-negative number, got '%.*s'", (int) seed_string.len, seed_string.data);
+        }
+
+        result->seed.set = true;
+        return true;
+    }
+
+    StringView no_repeat_from_string = sv_trim_prefix_or_null(opt, SV("no-repeat-from="));
+    if (!sv_is_null(no_repeat_from_string)) {
+        if (!parse_uint64(no_repeat_from_string, &result->no_repeat_from.value)) {
+            return cli_errorf("--no-repeat-from: Expected a non-negative number, got '%.*s'", (int) no_repeat_from_string.len, no_repeat_from_string.data);
+        }
+
+        result->no_repeat_from.set = true;
+        return true;
+    }
+
     if (sv_eql(opt, SV("help"))) {
         return cli_show_help();
     }
@@ -201,8 +339,14 @@ bool parse_cli_long_option(CliArgs* result, StringView arg) {
         return set_cli_switch(arg, &result->game_over_on_exceed_time_limit, !is_negated);
     } else if (sv_eql(fopt, SV("game-over-on-exceed-time-per-char-limit"))) {
         return set_cli_switch(arg, &result->game_over_on_exceed_time_per_char_limit, !is_negated);
+    } else if (sv_eql(fopt, SV("word-diff"))) {
+        return set_cli_switch(arg, &result->word_diff, !is_negated);
+    } else if (sv_eql(fopt, SV("live"))) {
+        return set_cli_switch(arg, &result->live, !is_negated);
     } else if (sv_eql(fopt, SV("retry"))) {
         return set_cli_switch(arg, &result->retry, !is_negated);
+    } else if (sv_eql(fopt, SV("repeat"))) {
+        return set_cli_switch(arg, &result->repeat, !is_negated);
     } else {
         return cli_errorf("%.*s: Unknown option. Use --help/-h for help", (int) arg.len, arg.data);
     }
@@ -225,6 +369,14 @@ bool parse_cli_short_option(CliArgs* result, StringView arg) {
             if (!set_cli_switch(arg, &result->retry, true)) {
                 return false;
             }
+        } else if (opt == 'w') {
+            if (!set_cli_switch(arg, &result->word_diff, true)) {
+                return false;
+            }
+        } else if (opt == 'l') {
+            if (!set_cli_switch(arg, &result->live, true)) {
+                return false;
+            }
         } else if (opt == 'h') {
             return cli_show_help();
         } else {
@@ -236,16 +388,65 @@ bool parse_cli_short_option(CliArgs* result, StringView arg) {
 }
 
 bool parse_cli_argument(CliArgs* result, StringView arg) {
+    StringView pattern = sv_trim_prefix_or_null(arg, SV("@pattern:"));
+    if (!sv_is_null(pattern)) {
+        const char* error;
+        size_t error_pos;
+        GeneratorDataset generator_dataset = compile_pattern_generator_dataset(pattern, &error, &error_pos);
+        if (generator_dataset_is_null(&generator_dataset)) {
+            return cli_errorf("%.*s: %s at position %zu", (int) arg.len, arg.data, error, error_pos);
+        }
+
+        if (!cli_args_add_generator_dataset(result, generator_dataset, arg)) {
+            free_generator_dataset(&generator_dataset);
+            return false;
+        }
+        return true;
+    }
+
+    StringView markov_training_name = sv_trim_prefix_or_null(arg, SV("@markov:"));
+    if (!sv_is_null(markov_training_name)) {
+        size_t index_threads = result->index_threads.set ? result->index_threads.value : 0;
+        StringView training_builtin_name = sv_trim_prefix_or_null(markov_training_name, SV("@"));
+        DataSet training_dataset = sv_is_null(training_builtin_name)
+            ? load_dataset(markov_training_name, index_threads)
+            : load_builtin_dataset(training_builtin_name);
+        if (dataset_is_null(&training_dataset)) {
+            return cli_errorf("%.*s: The %.*s dataset could not be loaded to train on.", (int) arg.len, arg.data, (int) markov_training_name.len, markov_training_name.data);
+        }
+
+        size_t order = result->markov_order.set ? result->markov_order.value : MARKOV_DEFAULT_ORDER;
+        GeneratorDataset generator_dataset = train_markov_generator_dataset(&training_dataset, order, index_threads);
+        free_dataset(&training_dataset);
+        if (generator_dataset_is_null(&generator_dataset)) {
+            return cli_errorf("%.*s: Could not train on an empty dataset.", (int) arg.len, arg.data);
+        }
+
+        if (!cli_args_add_generator_dataset(result, generator_dataset, arg)) {
+            free_generator_dataset(&generator_dataset);
+            return false;
+        }
+        return true;
+    }
+
     StringView builtin_dataset_name = sv_trim_prefix_or_null(arg, SV("@")); 
     if (!sv_is_null(builtin_dataset_name)) {
         DataSet dataset = load_builtin_dataset(builtin_dataset_name);
         if (!dataset_is_null(&dataset)) {
-            return cli_args_add_dataset(result, dataset);
+            if (!cli_args_add_dataset(result, dataset, arg)) {
+                free_dataset(&dataset);
+                return false;
+            }
+            return true;
         }
 
         GeneratorDataset generator_dataset = load_builtin_generator_dataset(builtin_dataset_name);
         if (!generator_dataset_is_null(&generator_dataset)) {
-            return cli_args_add_generator_dataset(result, generator_dataset);
+            if (!cli_args_add_generator_dataset(result, generator_dataset, arg)) {
+                free_generator_dataset(&generator_dataset);
+                return false;
+            }
+            return true;
         }
 
         size_t builtin_datasets_count;
@@ -265,12 +466,15 @@ bool parse_cli_argument(CliArgs* result, StringView arg) {
 
         return false;
     } else {
-        DataSet dataset = load_dataset(arg);
+        DataSet dataset = load_dataset(arg, result->index_threads.set ? result->index_threads.value : 0);
         if (dataset_is_null(&dataset)) {
             return cli_errorf("The %.*s dataset could not be read. Check if this file path truly exists and if it contains valid data.", (int) arg.len, arg.data);
         }
 
-        cli_args_add_dataset(result, dataset);
+        if (!cli_args_add_dataset(result, dataset, arg)) {
+            free_dataset(&dataset);
+            return false;
+        }
     }
 
     return true;
@@ -278,33 +482,58 @@ bool parse_cli_argument(CliArgs* result, StringView arg) {
 
 CliArgs parse_cli_args(int argc, char** argv) {
     CliArgs result = {0};
-    bool parse_flags = true;
-    for (size_t i = 1; i < (size_t) argc; ++i) {
-        StringView arg = sv_from_cstr(argv[i]);
-        
-        if (sv_eql(arg, SV("--")) && parse_flags) {
-            parse_flags = false;
-            continue;
-        }
 
-        if (parse_flags && sv_starts_with(arg, SV("--"))) {
-            if (!parse_cli_long_option(&result, arg)) {
-                return CLI_ARGS_NULL;
+    // options go first, so that they apply to every dataset regardless of where they were passed
+    for (int pass = 0; pass < 2; ++pass) {
+        bool parse_flags = true;
+        for (size_t i = 1; i < (size_t) argc; ++i) {
+            StringView arg = sv_from_cstr(argv[i]);
+
+            if (sv_eql(arg, SV("--")) && parse_flags) {
+                parse_flags = false;
+                continue;
             }
-        } else if (parse_flags && sv_starts_with(arg, SV("-"))) {
-            if (!parse_cli_short_option(&result, arg)) {
-                return CLI_ARGS_NULL;
+
+            // the only option that takes its value as a separate argument
+            if (parse_flags && sv_eql(arg, SV("--weight"))) {
+                if (i + 1 == (size_t) argc) {
+                    cli_error("--weight: Expected <dataset>=<weight> after it");
+                    return CLI_ARGS_NULL;
+                }
+                i++;
+                if (pass == 0 && !parse_cli_weight(&result, sv_from_cstr(argv[i]))) {
+                    return CLI_ARGS_NULL;
+                }
+                continue;
             }
-        } else {
-            if (!parse_cli_argument(&result, arg)) {
-                return CLI_ARGS_NULL;
+
+            bool is_option = parse_flags && sv_starts_with(arg, SV("-"));
+            if (is_option != (pass == 0)) continue;
+
+            if (parse_flags && sv_starts_with(arg, SV("--"))) {
+                if (!parse_cli_long_option(&result, arg)) {
+                    return CLI_ARGS_NULL;
+                }
+            } else if (parse_flags && sv_starts_with(arg, SV("-"))) {
+                if (!parse_cli_short_option(&result, arg)) {
+                    return CLI_ARGS_NULL;
+                }
+            } else {
+                if (!parse_cli_argument(&result, arg)) {
+                    return CLI_ARGS_NULL;
+                }
             }
         }
     }
 
     // if no dataset is specified, use the default setting
     if (result.datasets_count == 0 && result.generator_datasets_count == 0) {
-        result.datasets[result.datasets_count++] = load_builtin_dataset(SV("english-words"));
+        cli_args_add_dataset(&result, load_builtin_dataset(SV("english-words")), SV("@english-words"));
+    }
+
+    if (!apply_cli_weights(&result)) {
+        free_cli_args(&result);
+        return CLI_ARGS_NULL;
     }
     return result;
 }
@@ -313,4 +542,7 @@ void free_cli_args(CliArgs* args) {
     for (size_t i = 0; i < args->datasets_count; ++i) {
         free_dataset(&args->datasets[i]);
     }
+    for (size_t i = 0; i < args->generator_datasets_count; ++i) {
+        free_generator_dataset(&args->generator_datasets[i]);
+    }
 }
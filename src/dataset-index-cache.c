@@ -0,0 +1,192 @@
+#include "dataset-index-cache.h"
+
+#include "line-scan.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Sidecar layout: DataSetIndexCacheHeader followed by `elements_count` line ends of `line_end_size` bytes each.
+// The file is native-endian, it is a local cache and never meant to be shared between machines.
+#define DATASET_INDEX_CACHE_MAGIC   "TPVIDX\0\0"
+#define DATASET_INDEX_CACHE_VERSION 3
+
+typedef struct DataSetIndexCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t line_end_size;
+
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_ino;
+    uint64_t source_hash;
+
+    uint64_t elements_count;
+} DataSetIndexCacheHeader;
+
+static inline uint64_t fnv1a(uint64_t hash, const char* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+#define SOURCE_HASH_PRIME_1 0x9e3779b185ebca87ull
+#define SOURCE_HASH_PRIME_2 0xc2b2ae3d27d4eb4full
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t source_hash_round(uint64_t acc, uint64_t word) {
+    return rotl64(acc + word * SOURCE_HASH_PRIME_2, 31) * SOURCE_HASH_PRIME_1;
+}
+
+// Hashes every byte of the content, as a same-sized edit under an unchanged mtime must not reuse stale
+// line ends. Four independent lanes of 8-byte words keep it well above the speed of a line scan.
+static uint64_t hash_source_content(StringView raw_content) {
+    uint64_t lanes[4] = {
+        SOURCE_HASH_PRIME_1 + SOURCE_HASH_PRIME_2, SOURCE_HASH_PRIME_2, 0, -SOURCE_HASH_PRIME_1,
+    };
+
+    size_t i = 0;
+    for (; i + 32 <= raw_content.len; i += 32) {
+        for (size_t lane = 0; lane < 4; ++lane) {
+            uint64_t word;
+            memcpy(&word, raw_content.data + i + 8 * lane, sizeof word);
+            lanes[lane] = source_hash_round(lanes[lane], word);
+        }
+    }
+
+    uint64_t hash = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+    hash = fnv1a(hash, (const char*) &raw_content.len, sizeof raw_content.len);
+    return fnv1a(hash, raw_content.data + i, raw_content.len - i);
+}
+
+static DataSetIndexCacheHeader make_header(const struct stat* source_stat, uint64_t source_hash,
+                                           size_t line_end_size, size_t elements_count) {
+    DataSetIndexCacheHeader header = {0};
+    memcpy(header.magic, DATASET_INDEX_CACHE_MAGIC, sizeof header.magic);
+    header.version = DATASET_INDEX_CACHE_VERSION;
+    header.line_end_size = (uint32_t) line_end_size;
+    header.source_size = (uint64_t) source_stat->st_size;
+    header.source_mtime_sec = (int64_t) source_stat->st_mtim.tv_sec;
+    header.source_mtime_nsec = (int64_t) source_stat->st_mtim.tv_nsec;
+    header.source_ino = (uint64_t) source_stat->st_ino;
+    header.source_hash = source_hash;
+    header.elements_count = elements_count;
+    return header;
+}
+
+static inline char* cache_path_alloced(const char* filepath) {
+    size_t len = strlen(filepath);
+    char* path = malloc(len + sizeof(DATASET_INDEX_CACHE_SUFFIX));
+    if (path == NULL) return NULL;
+
+    memcpy(path, filepath, len);
+    memcpy(path + len, DATASET_INDEX_CACHE_SUFFIX, sizeof(DATASET_INDEX_CACHE_SUFFIX));
+    return path;
+}
+
+bool dataset_index_cache_load(const char* filepath, const struct stat* source_stat,
+                              size_t line_end_size, DataSetIndexCache* out_cache) {
+    char* path = cache_path_alloced(filepath);
+    if (path == NULL) goto e1;
+
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) goto e1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(DataSetIndexCacheHeader)) goto e2;
+
+    size_t mapping_len = (size_t) st.st_size;
+    void* mapping = mmap(NULL, mapping_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) goto e2;
+    close(fd);
+
+    const DataSetIndexCacheHeader* header = mapping;
+    if (memcmp(header->magic, DATASET_INDEX_CACHE_MAGIC, sizeof header->magic) != 0) goto e3;
+    if (header->version != DATASET_INDEX_CACHE_VERSION)                               goto e3;
+    if (header->line_end_size != line_end_size)                                       goto e3;
+    if (header->elements_count != (mapping_len - sizeof *header) / line_end_size)     goto e3;
+    if ((mapping_len - sizeof *header) % line_end_size != 0)                          goto e3;
+
+    // the content itself is left to dataset_index_cache_verify
+    DataSetIndexCacheHeader expected = make_header(source_stat, header->source_hash, line_end_size, header->elements_count);
+    if (memcmp(header, &expected, sizeof expected) != 0) goto e3;
+    if (header->elements_count == 0) goto e3;
+
+    const void* line_ends = header + 1;
+    *out_cache = (DataSetIndexCache) {
+        .line_ends = line_ends,
+        .line_end_size = line_end_size,
+        .elements_count = header->elements_count,
+        ._mapping = mapping,
+        ._mapping_len = mapping_len,
+    };
+    return true;
+
+e3: munmap(mapping, mapping_len);
+    return false;
+e2: close(fd);
+e1: return false;
+}
+
+bool dataset_index_cache_store(const char* filepath, const struct stat* source_stat, StringView raw_content,
+                               const void* line_ends, size_t line_end_size, size_t elements_count) {
+    char* path = cache_path_alloced(filepath);
+    if (path == NULL) goto e1;
+
+    // write to a temporary file and rename it, so readers never see a half-written index
+    char tmp_path[PATH_MAX];
+    int n = snprintf(tmp_path, sizeof tmp_path, "%s.%ld.tmp", path, (long) getpid());
+    if (n < 0 || (size_t) n >= sizeof tmp_path) goto e2;
+
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL) goto e2;
+
+    DataSetIndexCacheHeader header = make_header(source_stat, hash_source_content(raw_content), line_end_size, elements_count);
+    if (fwrite(&header, sizeof header, 1, file) != 1)                             goto e3;
+    if (fwrite(line_ends, line_end_size, elements_count, file) != elements_count) goto e3;
+
+    if (fclose(file) != 0) goto e4;
+    if (rename(tmp_path, path) != 0) goto e4;
+
+    free(path);
+    return true;
+
+e3: fclose(file);
+e4: remove(tmp_path);
+e2: free(path);
+e1: return false;
+}
+
+bool dataset_index_cache_verify(const DataSetIndexCache* cache, StringView raw_content) {
+    const DataSetIndexCacheHeader* header = cache->_mapping;
+    if (header->source_hash != hash_source_content(raw_content)) return false;
+
+    // the table has to be exactly the newlines of the content, in order, none missing and none extra
+    size_t batch[1024];
+    size_t from = 0, checked = 0, batch_len;
+    while ((batch_len = scan_line_ends(raw_content, &from, batch, sizeof batch / sizeof batch[0])) > 0) {
+        if (batch_len > cache->elements_count - checked) return false;
+        for (size_t i = 0; i < batch_len; ++i) {
+            if (line_end_at(cache->line_ends, cache->line_end_size, checked + i) != batch[i]) return false;
+        }
+        checked += batch_len;
+    }
+    return checked == cache->elements_count;
+}
+
+void dataset_index_cache_free(DataSetIndexCache* cache) {
+    if (cache->_mapping != NULL) {
+        munmap(cache->_mapping, cache->_mapping_len);
+    }
+}
@@ -1,8 +1,19 @@
 #include "dataset.h"
 
+#include "line-scan.h"
+#include "alias-table.h"
+#include "block-compression.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static inline char* read_file_alloced(const char* filepath, size_t* out_size) {
     FILE* file = fopen(filepath, "rb");
@@ -28,83 +39,656 @@ e2: fclose(file);
 e1: return NULL;
 }
 
-#define DATASET_ELEMENTS_INITIAL_CAPACITY 450000
+#define LINE_ENDS_BATCH 1024
+
+// Writes the offset of every '\n' in [from, to) of `raw_content` to `out_line_ends`.
+static void fill_line_ends(StringView raw_content, size_t from, size_t to, void* out_line_ends, size_t line_end_size) {
+    StringView content = sv_slice(raw_content, 0, to);
 
-static inline StringView* append_element(StringView** elements, size_t* elements_count, size_t* elements_cap, StringView elem) {
-    if (*elements_cap == *elements_count) {
-        *elements_cap = *elements_cap == 0 ? DATASET_ELEMENTS_INITIAL_CAPACITY : (size_t) ((double) *elements_count * 1.2);
-        StringView* new_elements = realloc(*elements, *elements_cap * sizeof(StringView));
-        if (new_elements == NULL) return NULL;
-        *elements = new_elements;
+    size_t batch[LINE_ENDS_BATCH];
+    size_t written = 0, batch_len;
+    while ((batch_len = scan_line_ends(content, &from, batch, LINE_ENDS_BATCH)) > 0) {
+        if (line_end_size == sizeof(uint32_t)) {
+            uint32_t* out = (uint32_t*) out_line_ends + written;
+            for (size_t i = 0; i < batch_len; ++i) out[i] = (uint32_t) batch[i];
+        } else {
+            uint64_t* out = (uint64_t*) out_line_ends + written;
+            for (size_t i = 0; i < batch_len; ++i) out[i] = (uint64_t) batch[i];
+        }
+        written += batch_len;
     }
+}
+
+// Returns a heap allocated table with the line ends of `content`, sized exactly to its number of lines,
+// or NULL if it has no complete line or the allocation fails.
+static void* parse_line_ends(StringView content, size_t line_end_size, size_t* out_elements_count) {
+    size_t elements_count = count_line_ends(content);
+    if (elements_count == 0) return NULL;
+
+    void* line_ends = malloc(elements_count * line_end_size);
+    if (line_ends == NULL) return NULL;
 
-    (*elements)[(*elements_count)++] = elem;
-    return *elements;
+    fill_line_ends(content, 0, content.len, line_ends, line_end_size);
+    *out_elements_count = elements_count;
+    return line_ends;
 }
 
-static inline StringView* parse_dataset_elements(StringView raw_content, size_t* out_elements_count) {
-    size_t elements_count = 0, elements_cap = 0;
-    StringView* elements = NULL;
+static inline void* map_file_readonly(const char* filepath, size_t* out_size, struct stat* out_stat) {
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) goto e1;
 
-    size_t last_element_start = 0;
-    for (size_t i = 0; i < raw_content.len; ++i) {
-        char c = raw_content.data[i];
-        if (c == '\n') {
-            if (append_element(&elements, &elements_count, &elements_cap,
-                               sv_slice(raw_content, last_element_start, i)) == NULL) {
-                goto e2;
-            }
-            last_element_start = i + 1;
-            continue;
+    if (fstat(fd, out_stat) != 0)    goto e2;
+    if (!S_ISREG(out_stat->st_mode)) goto e2;
+    if (out_stat->st_size <= 0)      goto e2;
+
+    void* data = mmap(NULL, (size_t) out_stat->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) goto e2;
+
+    close(fd);
+    *out_size = (size_t) out_stat->st_size;
+    return data;
+
+e2: close(fd);
+e1: return NULL;
+}
+
+// Files are split into chunks of at least DATASET_INDEX_MIN_CHUNK_BYTES, each ending at a newline.
+// Every chunk counts its lines on its own thread, then after a single allocation of the whole table
+// fills its slice of it. The result is identical to a single parse_line_ends pass.
+#define DATASET_INDEX_MIN_CHUNK_BYTES (4 * 1024 * 1024)
+#define DATASET_INDEX_MAX_THREADS     64
+
+size_t dataset_default_index_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    if (cpus > DATASET_INDEX_MAX_THREADS) return DATASET_INDEX_MAX_THREADS;
+    return (size_t) cpus;
+}
+
+typedef struct IndexChunk {
+    pthread_t thread;
+    bool thread_started;
+
+    StringView raw_content;
+    size_t from, to;
+
+    size_t elements_count;
+    void* out_line_ends;
+    size_t line_end_size;
+} IndexChunk;
+
+static void* index_chunk_count(void* arg) {
+    IndexChunk* chunk = arg;
+    chunk->elements_count = count_line_ends(sv_slice(chunk->raw_content, chunk->from, chunk->to));
+    return NULL;
+}
+
+static void* index_chunk_fill(void* arg) {
+    IndexChunk* chunk = arg;
+    fill_line_ends(chunk->raw_content, chunk->from, chunk->to, chunk->out_line_ends, chunk->line_end_size);
+    return NULL;
+}
+
+// Runs `fn` for every chunk, the calling thread takes the first chunk itself.
+static void run_index_chunks(IndexChunk* chunks, size_t chunks_count, void* (*fn)(void*)) {
+    for (size_t i = 1; i < chunks_count; ++i) {
+        chunks[i].thread_started = pthread_create(&chunks[i].thread, NULL, fn, &chunks[i]) == 0;
+    }
+    fn(&chunks[0]);
+
+    for (size_t i = 1; i < chunks_count; ++i) {
+        if (chunks[i].thread_started) {
+            pthread_join(chunks[i].thread, NULL);
+        } else {
+            fn(&chunks[i]);
+        }
+    }
+}
+
+static void* parse_line_ends_parallel(StringView raw_content, size_t line_end_size, size_t threads, size_t* out_elements_count) {
+    if (threads == 0) threads = dataset_default_index_threads();
+    if (threads > DATASET_INDEX_MAX_THREADS) threads = DATASET_INDEX_MAX_THREADS;
+    if (threads > raw_content.len / DATASET_INDEX_MIN_CHUNK_BYTES) threads = raw_content.len / DATASET_INDEX_MIN_CHUNK_BYTES;
+    if (threads <= 1) {
+        return parse_line_ends(raw_content, line_end_size, out_elements_count);
+    }
+
+    // cut off the unterminated tail, so that every chunk ends with a newline
+    size_t content_len = raw_content.len;
+    while (content_len > 0 && raw_content.data[content_len - 1] != '\n') content_len--;
+    if (content_len == 0) return NULL;
+
+    IndexChunk chunks[DATASET_INDEX_MAX_THREADS] = {0};
+    size_t chunks_count = 0;
+    for (size_t start = 0; start < content_len; ++chunks_count) {
+        size_t end = content_len * (chunks_count + 1) / threads;
+        if (end <= start) end = start + 1;
+
+        if (chunks_count + 1 == threads || end >= content_len) {
+            end = content_len;
+        } else {
+            end = (size_t) ((const char*) memchr(raw_content.data + end - 1, '\n', content_len - end + 1) - raw_content.data) + 1;
         }
+
+        chunks[chunks_count] = (IndexChunk) { .raw_content = raw_content, .from = start, .to = end, .line_end_size = line_end_size };
+        start = end;
     }
 
+    run_index_chunks(chunks, chunks_count, index_chunk_count);
+
+    size_t elements_count = 0;
+    for (size_t i = 0; i < chunks_count; ++i) {
+        elements_count += chunks[i].elements_count;
+    }
+
+    char* line_ends = malloc(elements_count * line_end_size);
+    if (line_ends == NULL) return NULL;
+
+    char* out = line_ends;
+    for (size_t i = 0; i < chunks_count; ++i) {
+        chunks[i].out_line_ends = out;
+        out += chunks[i].elements_count * line_end_size;
+    }
+
+    run_index_chunks(chunks, chunks_count, index_chunk_fill);
+
     *out_elements_count = elements_count;
-    return elements;
+    return line_ends;
+}
+
+// Splits `text<TAB>weight`, where weight is a non-negative decimal number, leaves the outputs alone otherwise
+static bool split_weight_column(StringView line, StringView* out_text, double* out_weight) {
+    size_t tab = line.len;
+    while (tab > 0 && line.data[tab - 1] != '\t') tab--;
+    if (tab == 0 || tab == line.len) return false;
+
+    double weight = 0.0, scale = 1.0;
+    bool seen_digit = false, seen_dot = false;
+    for (size_t i = tab; i < line.len; ++i) {
+        char c = line.data[i];
+        if (c == '.' && !seen_dot) {
+            seen_dot = true;
+        } else if (c >= '0' && c <= '9') {
+            seen_digit = true;
+            if (seen_dot) weight += (c - '0') * (scale /= 10.0);
+            else          weight = weight * 10.0 + (c - '0');
+        } else {
+            return false;
+        }
+    }
+    if (!seen_digit) return false;
+
+    *out_text = sv_slice(line, 0, tab - 1);
+    *out_weight = weight;
+    return true;
+}
+
+static inline StringView raw_element(StringView raw_content, const void* line_ends, size_t line_end_size, size_t index) {
+    size_t start = index == 0 ? 0 : (size_t) line_end_at(line_ends, line_end_size, index - 1) + 1;
+    size_t end = (size_t) line_end_at(line_ends, line_end_size, index);
+    if (start > end || end > raw_content.len) return sv_slice(raw_content, 0, 0);
+    return sv_slice(raw_content, start, end);
+}
+
+static bool has_weight_column(StringView raw_content, const void* line_ends, size_t line_end_size, size_t elements_count) {
+    if (elements_count == 0) return false;
+
+    StringView text; double weight;
+    return split_weight_column(raw_element(raw_content, line_ends, line_end_size, 0), &text, &weight);
+}
 
-e2: free(elements);
+static bool build_element_weights(StringView raw_content, const void* line_ends, size_t line_end_size, size_t elements_count, AliasTable* out) {
+    double* weights = malloc(elements_count * sizeof(double));
+    if (weights == NULL) return false;
+
+    for (size_t i = 0; i < elements_count; ++i) {
+        StringView text; double weight = 1.0;
+        split_weight_column(raw_element(raw_content, line_ends, line_end_size, i), &text, &weight);
+        weights[i] = weight;
+    }
+
+    bool built = build_alias_table(out, weights, elements_count);
+    free(weights);
+    return built;
+}
+
+// Lines within the first DATASET_HEAD_INDEX_BYTES are indexed before load_dataset returns,
+// so the first prompts can be drawn while the rest of the file is indexed in the background.
+#define DATASET_HEAD_INDEX_BYTES (64 * 1024)
+
+struct DataSetIndexer {
+    pthread_t thread;
+    StringView raw_content;
+    size_t threads;
+
+    // where to persist the finished index, NULL if it should not be cached
+    char* cache_filepath;
+    struct stat source_stat;
+
+    // the sidecar index, to be verified against the whole file before its line ends are used past the head
+    DataSetIndexCache cache;
+    // the sidecar's line ends, cleared when they turn out to be stale and the file is indexed again
+    const void* known_line_ends;
+    size_t known_elements_count;
+    bool weighted;
+
+    void* line_ends;
+    size_t line_end_size;
+    size_t elements_count;
+    AliasTable weights;
+    atomic_bool done;
+};
+
+static void* dataset_indexer_run(void* arg) {
+    DataSetIndexer* indexer = arg;
+    if (indexer->known_line_ends != NULL && !dataset_index_cache_verify(&indexer->cache, indexer->raw_content)) {
+        indexer->known_line_ends = NULL;
+    }
+
+    const void* line_ends = indexer->known_line_ends;
+    size_t elements_count = indexer->known_elements_count;
+
+    if (line_ends == NULL) {
+        indexer->line_ends = parse_line_ends_parallel(indexer->raw_content, indexer->line_end_size, indexer->threads, &indexer->elements_count);
+        if (indexer->line_ends != NULL && indexer->cache_filepath != NULL) {
+            dataset_index_cache_store(indexer->cache_filepath, &indexer->source_stat, indexer->raw_content,
+                                      indexer->line_ends, indexer->line_end_size, indexer->elements_count);
+        }
+        line_ends = indexer->line_ends;
+        elements_count = indexer->elements_count;
+    }
+
+    // on failure weighted draws fall back to uniform ones
+    if (line_ends != NULL && indexer->weighted) {
+        build_element_weights(indexer->raw_content, line_ends, indexer->line_end_size, elements_count, &indexer->weights);
+    }
+
+    atomic_store_explicit(&indexer->done, true, memory_order_release);
     return NULL;
 }
 
-DataSet load_dataset(StringView filepath){
-    DataSet result;
+static void dataset_indexer_free(DataSetIndexer* indexer) {
+    pthread_join(indexer->thread, NULL);
+    free(indexer->line_ends);
+    free_alias_table(&indexer->weights);
+    free(indexer->cache_filepath);
+    free(indexer);
+}
+
+// A loaded `dataset->_index_cache` is verified and then reused, otherwise or when it is stale the whole
+// file is indexed again and the result stored at `cache_filepath`, if any
+static bool start_dataset_indexer(DataSet* dataset, size_t threads, const char* cache_filepath, const struct stat* source_stat) {
+    DataSetIndexer* indexer = calloc(1, sizeof(DataSetIndexer));
+    if (indexer == NULL) return false;
+
+    indexer->raw_content = dataset->raw_content;
+    indexer->threads = threads;
+    indexer->line_end_size = dataset->line_end_size;
+    indexer->weighted = dataset->_weighted;
+    if (dataset->_index_cache._mapping != NULL) {
+        indexer->cache = dataset->_index_cache;
+        indexer->known_line_ends = dataset->_index_cache.line_ends;
+        indexer->known_elements_count = dataset->_index_cache.elements_count;
+    }
+    if (cache_filepath != NULL) {
+        indexer->cache_filepath = strdup(cache_filepath);
+        indexer->source_stat = *source_stat;
+    }
+    atomic_init(&indexer->done, false);
+
+    if (pthread_create(&indexer->thread, NULL, dataset_indexer_run, indexer) != 0) {
+        free(indexer->cache_filepath);
+        free(indexer);
+        return false;
+    }
+
+    dataset->_indexer = indexer;
+    return true;
+}
+
+static inline void build_dataset_weights(DataSet* dataset) {
+    if (!dataset->_weighted) return;
+    build_element_weights(dataset->raw_content, dataset->line_ends, dataset->line_end_size, dataset->elements_count, &dataset->_weights);
+}
+
+static inline void set_dataset_line_ends(DataSet* dataset, void* line_ends, size_t elements_count) {
+    free(dataset->_line_ends_owned);
+    dataset->_line_ends_owned = line_ends;
+    dataset->line_ends = line_ends;
+    dataset->elements_count = elements_count;
+}
+
+// The first DATASET_HEAD_INDEX_BYTES and the rest of the line they end in
+static size_t head_index_len(StringView raw_content) {
+    if (raw_content.len <= DATASET_HEAD_INDEX_BYTES) return raw_content.len;
+
+    const char* nl = memchr(raw_content.data + DATASET_HEAD_INDEX_BYTES, '\n', raw_content.len - DATASET_HEAD_INDEX_BYTES);
+    return nl == NULL ? raw_content.len : (size_t) (nl - raw_content.data) + 1;
+}
+
+static inline bool index_dataset(DataSet* dataset, size_t threads, const char* cache_filepath, const struct stat* source_stat) {
+    StringView raw_content = dataset->raw_content;
+    size_t line_end_size = dataset->line_end_size;
+    size_t elements_count;
+    size_t head_len = head_index_len(raw_content);
+
+    dataset->_indexer = NULL;
+    void* line_ends = parse_line_ends(sv_slice(raw_content, 0, head_len), line_end_size, &elements_count);
+    if (line_ends == NULL) return false;
+
+    set_dataset_line_ends(dataset, line_ends, elements_count);
+    dataset->_weighted = has_weight_column(raw_content, line_ends, line_end_size, elements_count);
+    if (head_len == raw_content.len) {
+        build_dataset_weights(dataset);
+        return true;
+    }
+
+    if (start_dataset_indexer(dataset, threads, cache_filepath, source_stat)) return true;
+
+    // no background thread available, index the whole file right away
+    line_ends = parse_line_ends_parallel(raw_content, line_end_size, threads, &elements_count);
+    if (line_ends != NULL) {
+        set_dataset_line_ends(dataset, line_ends, elements_count);
+    }
+    build_dataset_weights(dataset);
+    return true;
+}
+
+void dataset_poll_index(DataSet* dataset) {
+    DataSetIndexer* indexer = dataset->_indexer;
+    if (indexer == NULL) return;
+    if (!atomic_load_explicit(&indexer->done, memory_order_acquire)) return;
 
-    result._raw_content_owned = read_file_alloced(filepath.data, &result.raw_content.len);
-    if (result._raw_content_owned == NULL) goto e1;
+    dataset_wait_index(dataset);
+}
 
-    result.raw_content.data = result._raw_content_owned;
+void dataset_wait_index(DataSet* dataset) {
+    DataSetIndexer* indexer = dataset->_indexer;
+    if (indexer == NULL) return;
 
-    result.elements = parse_dataset_elements(result.raw_content, &result.elements_count);
-    if (result.elements == NULL) goto e2;
+    pthread_join(indexer->thread, NULL);
+    // on allocation failure in the indexer keep serving the head index
+    if (indexer->line_ends != NULL) {
+        set_dataset_line_ends(dataset, indexer->line_ends, indexer->elements_count);
+    } else if (indexer->known_line_ends != NULL) {
+        dataset->elements_count = indexer->known_elements_count;
+    }
+    dataset->_weights = indexer->weights;
+
+    free(indexer->cache_filepath);
+    free(indexer);
+    dataset->_indexer = NULL;
+}
+
+// Number of line ends of the cached table within the head of the file, 0 unless they all match its content
+static size_t verified_cached_head_count(StringView raw_content, const DataSetIndexCache* cache) {
+    StringView head = sv_slice(raw_content, 0, head_index_len(raw_content));
+
+    size_t batch[LINE_ENDS_BATCH];
+    size_t from = 0, count = 0, batch_len;
+    while ((batch_len = scan_line_ends(head, &from, batch, LINE_ENDS_BATCH)) > 0) {
+        if (batch_len > cache->elements_count - count) return 0;
+        for (size_t i = 0; i < batch_len; ++i) {
+            if (line_end_at(cache->line_ends, cache->line_end_size, count + i) != batch[i]) return 0;
+        }
+        count += batch_len;
+    }
+    return count;
+}
+
+// Serves the head of a sidecar index as soon as it matches the content, the rest of it only once the
+// background indexer has verified the whole file against it
+static bool serve_cached_head(DataSet* dataset, size_t threads, const char* cache_filepath, const struct stat* source_stat) {
+    const DataSetIndexCache* cache = &dataset->_index_cache;
+    size_t head_count = verified_cached_head_count(dataset->raw_content, cache);
+    if (head_count == 0) return false;
+
+    dataset->line_ends = cache->line_ends;
+    dataset->elements_count = head_count;
+    dataset->_weighted = has_weight_column(dataset->raw_content, dataset->line_ends, dataset->line_end_size, head_count);
+    if (start_dataset_indexer(dataset, threads, cache_filepath, source_stat)) return true;
+
+    // no background thread available, verify right away
+    if (!dataset_index_cache_verify(cache, dataset->raw_content)) return false;
+    dataset->elements_count = cache->elements_count;
+    build_dataset_weights(dataset);
+    return true;
+}
+
+DataSet load_dataset(StringView filepath, size_t index_threads) {
+    DataSet result = DATASET_NULL;
+    const char* cache_filepath = NULL;
+
+    struct stat source_stat;
+    result._mapping = map_file_readonly(filepath.data, &result._mapping_len, &source_stat);
+    if (result._mapping != NULL) {
+        result.raw_content = sv_from_data_and_len(result._mapping, result._mapping_len);
+        result.line_end_size = line_end_size_for(result.raw_content.len);
+
+        // files small enough to be indexed up front are not worth a sidecar
+        if (result.raw_content.len > DATASET_HEAD_INDEX_BYTES) {
+            cache_filepath = filepath.data;
+            if (dataset_index_cache_load(filepath.data, &source_stat, result.line_end_size, &result._index_cache)) {
+                if (serve_cached_head(&result, index_threads, cache_filepath, &source_stat)) return result;
+
+                dataset_index_cache_free(&result._index_cache);
+                result._index_cache = DATASET_INDEX_CACHE_NULL;
+            }
+        }
+    } else {
+        // not a regular file (or mmap is unavailable), fall back to reading it into memory
+        result._raw_content_owned = read_file_alloced(filepath.data, &result.raw_content.len);
+        if (result._raw_content_owned == NULL) goto e1;
+
+        result.raw_content.data = result._raw_content_owned;
+        result.line_end_size = line_end_size_for(result.raw_content.len);
+    }
+
+    if (!index_dataset(&result, index_threads, cache_filepath, &source_stat)) goto e2;
 
     return result;
 
-e2: free(result._raw_content_owned);
+e2: if (result._mapping != NULL) munmap(result._mapping, result._mapping_len);
+    free(result._raw_content_owned);
 e1: return DATASET_NULL;
 }
 
 DataSet parse_dataset_from_str(StringView raw_content) {
-    DataSet result;
-    
-    result._raw_content_owned = NULL;
+    DataSet result = DATASET_NULL;
+    result.raw_content = raw_content;
+    result.line_end_size = line_end_size_for(raw_content.len);
+
+    result._line_ends_owned = parse_line_ends(raw_content, result.line_end_size, &result.elements_count);
+    if (result._line_ends_owned == NULL) return DATASET_NULL;
+    result.line_ends = result._line_ends_owned;
+
+    result._weighted = has_weight_column(raw_content, result.line_ends, result.line_end_size, result.elements_count);
+    build_dataset_weights(&result);
+
+    return result;
+}
+
+DataSet dataset_from_line_ends(StringView raw_content, const void* line_ends, size_t line_end_size, size_t elements_count) {
+    if (elements_count == 0) return DATASET_NULL;
+
+    DataSet result = DATASET_NULL;
     result.raw_content = raw_content;
+    result.line_ends = line_ends;
+    result.line_end_size = line_end_size;
+    result.elements_count = elements_count;
+    return result;
+}
+
+DataSet dataset_from_compressed_blocks(DataSetBlocks blocks) {
+    if (blocks.blocks_count == 0) return DATASET_NULL;
 
-    result.elements = parse_dataset_elements(result.raw_content, &result.elements_count);
-    if (result.elements == NULL) return DATASET_NULL;
+    const uint32_t* end = &blocks.offsets[3 * blocks.blocks_count];
+    if (end[2] == 0) return DATASET_NULL;
 
+    DataSet result = DATASET_NULL;
+    result.raw_content = sv_from_data_and_len((const char*) blocks.data, end[0]);
+    result.elements_count = end[2];
+    result._blocks = blocks;
     return result;
 }
 
 void free_dataset(DataSet* dataset) {
-    free(dataset->elements);
+    if (dataset->_indexer != NULL) {
+        dataset_indexer_free(dataset->_indexer);
+    }
+    free(dataset->_line_ends_owned);
+    free_alias_table(&dataset->_weights);
     if (dataset->_raw_content_owned != NULL) {
         free(dataset->_raw_content_owned);
     }
+    if (dataset->_mapping != NULL) {
+        munmap(dataset->_mapping, dataset->_mapping_len);
+    }
+    dataset_index_cache_free(&dataset->_index_cache);
 }
 
-StringView random_dataset_element(DataSet* dataset) {
+#define DATASET_BLOCK_CACHE_SLOTS 8
+
+typedef struct BlockCacheSlot {
+    const unsigned char* block; // compressed block this slot holds, NULL if empty
+    uint64_t last_used;
+    uint16_t line_ends[DATASET_BLOCK_MAX_LINES];
+    char data[DATASET_BLOCK_SIZE];
+} BlockCacheSlot;
+
+typedef struct BlockCache {
+    BlockCacheSlot slots[DATASET_BLOCK_CACHE_SLOTS];
+    uint64_t clock;
+} BlockCache;
+
+// Every thread gets its own cache, allocated on its first compressed element and freed when it exits
+static pthread_key_t block_cache_key;
+static pthread_once_t block_cache_key_once = PTHREAD_ONCE_INIT;
+static bool block_cache_key_created;
+
+static void create_block_cache_key(void) {
+    block_cache_key_created = pthread_key_create(&block_cache_key, free) == 0;
+}
+
+static BlockCache* thread_block_cache(void) {
+    pthread_once(&block_cache_key_once, create_block_cache_key);
+    if (!block_cache_key_created) return NULL;
+
+    BlockCache* cache = pthread_getspecific(block_cache_key);
+    if (cache == NULL) {
+        cache = calloc(1, sizeof(BlockCache));
+        if (cache == NULL) return NULL;
+        if (pthread_setspecific(block_cache_key, cache) != 0) {
+            free(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+// A block has to end in exactly `lines_count` newlines, or its table and content disagree
+static bool index_block_lines(BlockCacheSlot* slot, size_t len, size_t lines_count) {
+    size_t batch[LINE_ENDS_BATCH];
+    size_t from = 0, count = 0, batch_len;
+    while ((batch_len = scan_line_ends(sv_from_data_and_len(slot->data, len), &from, batch, LINE_ENDS_BATCH)) > 0) {
+        if (batch_len > lines_count - count) return false;
+        for (size_t i = 0; i < batch_len; ++i) {
+            slot->line_ends[count + i] = (uint16_t) batch[i];
+        }
+        count += batch_len;
+    }
+    return count == lines_count && len > 0 && slot->data[len - 1] == '\n';
+}
+
+static const BlockCacheSlot* decompressed_block(const unsigned char* block, size_t compressed_len, size_t len, size_t lines_count) {
+    BlockCache* cache = thread_block_cache();
+    if (cache == NULL) return NULL;
+
+    BlockCacheSlot* lru = &cache->slots[0];
+    for (BlockCacheSlot* slot = cache->slots; slot < cache->slots + DATASET_BLOCK_CACHE_SLOTS; ++slot) {
+        if (slot->block == block) {
+            slot->last_used = ++cache->clock;
+            return slot;
+        }
+        if (slot->last_used < lru->last_used) lru = slot;
+    }
+
+    if (len > DATASET_BLOCK_SIZE || lines_count > DATASET_BLOCK_MAX_LINES) return NULL;
+
+    lru->block = NULL;
+    if (!decompress_block(block, compressed_len, lru->data, len)) return NULL;
+    if (!index_block_lines(lru, len, lines_count)) return NULL;
+
+    lru->block = block;
+    lru->last_used = ++cache->clock;
+    return lru;
+}
+
+static StringView compressed_dataset_element(DataSet* dataset, size_t index) {
+    const DataSetBlocks* blocks = &dataset->_blocks;
+
+    // find the last block whose first element is at or before `index`
+    size_t lo = 0, hi = blocks->blocks_count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (blocks->offsets[3 * mid + 2] <= index) lo = mid;
+        else hi = mid;
+    }
+
+    const uint32_t* offsets = &blocks->offsets[3 * lo];
+    size_t first_element = offsets[2], lines_count = offsets[5] - offsets[2];
+    if (index < first_element || index - first_element >= lines_count) return SV_NULL;
+
+    const BlockCacheSlot* block = decompressed_block(blocks->data + offsets[0], offsets[3] - offsets[0], offsets[4] - offsets[1], lines_count);
+    if (block == NULL) return SV_NULL;
+
+    size_t line = index - first_element;
+    size_t start = line == 0 ? 0 : (size_t) block->line_ends[line - 1] + 1;
+    return sv_from_data_and_len(block->data + start, block->line_ends[line] - start);
+}
+
+StringView dataset_element(DataSet* dataset, size_t index) {
+    if (dataset->_blocks.blocks_count > 0) {
+        return compressed_dataset_element(dataset, index);
+    }
+
+    size_t start = index == 0 ? 0 : (size_t) line_end_at(dataset->line_ends, dataset->line_end_size, index - 1) + 1;
+    size_t end = (size_t) line_end_at(dataset->line_ends, dataset->line_end_size, index);
+
+    // never trust a cached index blindly, a stale entry must not yield a torn line
+    if (start > end || end >= dataset->raw_content.len || dataset->raw_content.data[end] != '\n') {
+        return SV_NULL;
+    }
+
+    StringView element = sv_slice(dataset->raw_content, start, end);
+    if (dataset->_weighted) {
+        double weight;
+        split_weight_column(element, &element, &weight);
+    }
+    return element;
+}
+
+StringView random_dataset_element(DataSet* dataset, Rng* rng) {
+    dataset_poll_index(dataset);
     if (dataset->elements_count == 0) {
         return SV_NULL;
     }
-    return dataset->elements[rand() % dataset->elements_count];
+
+    // weighted datasets are drawn uniformly from their head until the background indexer is done
+    if (dataset->_weights.count == dataset->elements_count) {
+        return dataset_element(dataset, alias_table_sample(&dataset->_weights, rng));
+    }
+    return dataset_element(dataset, rng_below(rng, dataset->elements_count));
+}
+
+size_t dataset_longest_element_len(DataSet* dataset) {
+    if (dataset->_blocks.blocks_count > 0) return dataset->_blocks.longest_element_len;
+
+    size_t longest = 0, start = 0;
+    for (size_t i = 0; i < dataset->elements_count; ++i) {
+        size_t end = (size_t) line_end_at(dataset->line_ends, dataset->line_end_size, i);
+        if (end >= start && end - start > longest) longest = end - start;
+        start = end + 1;
+    }
+    return longest;
 }
@@ -1,57 +1,199 @@
 #include "datasets-utils.h"
 
 #include "sv.h"
+#include "rng.h"
 #include "dataset.h"
+#include "alias-table.h"
+#include "permutation.h"
 #include "generator-dataset.h"
 
 #include <stdlib.h>
 
-StringView random_element_from_many_datasets(DataSet* datasets, size_t datasets_count) {
-    if (datasets_count == 0) return SV_NULL;
-    
-    size_t all_datasets_elements_count = 0;
-    for (DataSet* dataset = datasets; dataset < datasets + datasets_count; ++dataset) {
-        all_datasets_elements_count += dataset->elements_count;
+static inline double dataset_weight(DataSetsSampler* sampler, size_t i) {
+    return sampler->dataset_weights != NULL ? sampler->dataset_weights[i] : 1.0;
+}
+
+static inline double generator_weight(DataSetsSampler* sampler, size_t i) {
+    return sampler->generator_weights != NULL ? sampler->generator_weights[i] : 1.0;
+}
+
+// With all weights at 1 this keeps the old split: generators as a whole get generator_prob scaled
+// by their share of the sources, datasets share the rest in proportion to their element counts.
+static bool build_sources_table(DataSetsSampler* sampler) {
+    size_t real_count = sampler->datasets_count;
+    size_t gen_count = sampler->generators_count;
+
+    double* masses = malloc((real_count + gen_count) * sizeof(double));
+    if (masses == NULL) return false;
+
+    double real_weights_sum = 0.0, real_masses_sum = 0.0, gen_weights_sum = 0.0;
+    for (size_t i = 0; i < real_count; ++i) {
+        real_weights_sum += dataset_weight(sampler, i);
+        masses[i] = dataset_weight(sampler, i) * (double) sampler->datasets[i].elements_count;
+        real_masses_sum += masses[i];
+    }
+    for (size_t i = 0; i < gen_count; ++i) {
+        gen_weights_sum += generator_weight(sampler, i);
+    }
+
+    double gen_share = 0.0;
+    if (gen_weights_sum > 0.0) {
+        gen_share = real_masses_sum > 0.0
+            ? sampler->generator_prob * gen_weights_sum / (real_weights_sum + gen_weights_sum)
+            : 1.0;
     }
 
-    size_t index = rand() % all_datasets_elements_count;
+    for (size_t i = 0; i < real_count; ++i) {
+        masses[i] = real_masses_sum > 0.0 ? (1.0 - gen_share) * masses[i] / real_masses_sum : 0.0;
+    }
+    for (size_t i = 0; i < gen_count; ++i) {
+        masses[real_count + i] = gen_share > 0.0 ? gen_share * generator_weight(sampler, i) / gen_weights_sum : 0.0;
+    }
 
-    for (DataSet* dataset = datasets; dataset < datasets + datasets_count; ++dataset) {
-        if (index < dataset->elements_count) {
-            return dataset->elements[index];
+    // nothing to draw from while datasets are still being indexed is not an error, the table stays empty
+    if (real_masses_sum == 0.0 && gen_share == 0.0) {
+        free(masses);
+        if (sampler->pending_indexes_count == 0) return false;
+
+        free_alias_table(&sampler->sources);
+        return true;
+    }
+
+    AliasTable sources;
+    bool built = build_alias_table(&sources, masses, real_count + gen_count);
+    free(masses);
+    if (!built) return false;
+
+    free_alias_table(&sampler->sources);
+    sampler->sources = sources;
+    return true;
+}
+
+static void update_pending_indexes_count(DataSetsSampler* sampler) {
+    sampler->pending_indexes_count = 0;
+    for (size_t i = 0; i < sampler->datasets_count; ++i) {
+        if (sampler->datasets[i]._indexer != NULL) {
+            sampler->pending_indexes_count++;
         }
+    }
+}
+
+DataSetsSampler init_datasets_sampler(DataSet* real, const double* real_weights, size_t real_count,
+                                      GeneratorDataset* gen, const double* gen_weights, size_t gen_count,
+                                      double gen_prob) {
+    DataSetsSampler sampler = {0};
+    sampler.datasets = real;
+    sampler.dataset_weights = real_weights;
+    sampler.datasets_count = real_count;
+    sampler.generators = gen;
+    sampler.generator_weights = gen_weights;
+    sampler.generators_count = gen_count;
+    sampler.generator_prob = gen_prob;
+
+    sampler.generator_batches = calloc(gen_count > 0 ? gen_count : 1, sizeof(GeneratorBatch));
+    if (sampler.generator_batches == NULL) goto e1;
+
+    update_pending_indexes_count(&sampler);
+    if (!build_sources_table(&sampler)) goto e2;
 
-        index -= dataset->elements_count;
+    return sampler;
+
+e2: free(sampler.generator_batches);
+e1: return DATASETS_SAMPLER_NULL;
+}
+
+void free_datasets_sampler(DataSetsSampler* sampler) {
+    free_alias_table(&sampler->sources);
+    free(sampler->cumulative_counts);
+    free(sampler->generator_batches);
+}
+
+bool datasets_sampler_enable_no_repeat(DataSetsSampler* sampler, uint64_t key, uint64_t position) {
+    if (sampler->datasets_count == 0) return true;
+
+    size_t* cumulative_counts = malloc(sampler->datasets_count * sizeof(size_t));
+    if (cumulative_counts == NULL) return false;
+
+    size_t all_datasets_elements_count = 0;
+    for (size_t i = 0; i < sampler->datasets_count; ++i) {
+        all_datasets_elements_count += sampler->datasets[i].elements_count;
+        cumulative_counts[i] = all_datasets_elements_count;
     }
 
-    return SV_NULL;
+    free(sampler->cumulative_counts);
+    sampler->cumulative_counts = cumulative_counts;
+    sampler->no_repeat = true;
+    sampler->no_repeat_key = key;
+    sampler->no_repeat_position = position;
+    sampler->no_repeat_order = (Permutation) { 0 };
+    return true;
 }
 
-StringView random_element(DataSet* real, size_t real_count,
-                          GeneratorDataset* gen, size_t gen_count,
-                          double gen_prob) {
-    if (real_count == 0 && gen_count == 0)
-        return SV_NULL;
+static StringView next_unrepeated_element(DataSetsSampler* sampler) {
+    const size_t* cumulative_counts = sampler->cumulative_counts;
+    uint64_t all_datasets_elements_count = cumulative_counts[sampler->datasets_count - 1];
+    if (all_datasets_elements_count == 0) return SV_NULL;
+
+    uint64_t pass = sampler->no_repeat_position / all_datasets_elements_count;
+    uint64_t offset = sampler->no_repeat_position % all_datasets_elements_count;
+    if (offset == 0 || sampler->no_repeat_order.domain != all_datasets_elements_count) {
+        uint64_t pass_key = sampler->no_repeat_key ^ splitmix64(&pass);
+        sampler->no_repeat_order = permutation_from_key(all_datasets_elements_count, pass_key);
+    }
+    sampler->no_repeat_position++;
+
+    size_t index = (size_t) permutation_at(&sampler->no_repeat_order, offset);
 
-    double ratio = 0.0;
-    if (real_count + gen_count > 0)
-        ratio = (double) gen_count / (real_count + gen_count);
+    // first dataset whose cumulative count exceeds the index
+    size_t lo = 0, hi = sampler->datasets_count - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cumulative_counts[mid] > index) hi = mid;
+        else lo = mid + 1;
+    }
+
+    size_t preceding_elements_count = lo == 0 ? 0 : cumulative_counts[lo - 1];
+    return dataset_element(&sampler->datasets[lo], index - preceding_elements_count);
+}
 
-    double adjusted_prob = gen_prob * ratio;
-    double r = (double) rand() / RAND_MAX;
-    bool use_gen = (r < adjusted_prob);
+static void poll_pending_indexes(DataSetsSampler* sampler) {
+    if (sampler->pending_indexes_count == 0) return;
 
-    if (use_gen && gen_count > 0) {
-        size_t i = rand() % gen_count;
-        return gen[i].gen();
+    size_t previous_pending_indexes_count = sampler->pending_indexes_count;
+    for (DataSet* dataset = sampler->datasets; dataset < sampler->datasets + sampler->datasets_count; ++dataset) {
+        dataset_poll_index(dataset);
     }
+    update_pending_indexes_count(sampler);
 
-    if (real_count > 0)
-        return random_element_from_many_datasets(real, real_count);
+    if (sampler->pending_indexes_count < previous_pending_indexes_count) {
+        // on failure the old table is kept, it is only missing the newly indexed elements
+        build_sources_table(sampler);
+    }
+}
 
-    if (gen_count > 0)
-        return gen[rand() % gen_count].gen();
+static StringView next_generated_element(DataSetsSampler* sampler, size_t generator_index) {
+    GeneratorBatch* batch = &sampler->generator_batches[generator_index];
+    if (batch->next == batch->count) {
+        batch->count = generator_dataset_gen_batch(&sampler->generators[generator_index],
+                                                   batch->arena, sizeof(batch->arena), batch->items, GENERATOR_BATCH_SIZE);
+        batch->next = 0;
+        if (batch->count == 0) return SV_NULL;
+    }
 
-    return SV_NULL;
+    return batch->items[batch->next++];
 }
 
+StringView random_element(DataSetsSampler* sampler, Rng* rng) {
+    poll_pending_indexes(sampler);
+    if (sampler->sources.count == 0) return SV_NULL;
+
+    size_t source = alias_table_sample(&sampler->sources, rng);
+    if (source < sampler->datasets_count && sampler->no_repeat) {
+        return next_unrepeated_element(sampler);
+    }
+    if (source < sampler->datasets_count) {
+        return random_dataset_element(&sampler->datasets[source], rng);
+    }
+
+    return next_generated_element(sampler, source - sampler->datasets_count);
+}
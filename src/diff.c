@@ -1,47 +1,676 @@
+#include "diff.h"
+
 #include "sv.h"
 #include "ansi.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Two engines behind one edit script, after the common prefix and suffix are stripped:
+//  - Myers' O(ND) diff in linear space for near misses: the middle snake of a box splits it into a head
+//    and a tail box, which are worked off an explicit stack instead of recursing. Every box only needs
+//    the two V arrays sized for the whole diff, plus one byte per edit for the script.
+//  - A bit-parallel LCS (Hyyrö's variant of Allison-Dix) for lines far apart, 64 columns per word in
+//    O(n * m / 64), once Myers has spent about as long without finding the middle of the top box.
+// By tokens, Myers first runs over interned token ids and only the changed runs of tokens go through the above.
+
+// rows and symbol masks of the bit-parallel LCS are kept for the traceback, past this Myers runs to the end instead
+#ifndef DIFF_BIT_PARALLEL_MAX_WORDS
+#   define DIFF_BIT_PARALLEL_MAX_WORDS (1u << 20)
+#endif
+
+// Myers steps one word of a bit-parallel row costs, rows and traceback included, and the middle snake
+// steps Myers gets on top, both fitted on typed built-in dataset lines by bench/diff.c
+#ifndef DIFF_BIT_PARALLEL_WORD_COST
+#   define DIFF_BIT_PARALLEL_WORD_COST 10
+#endif
+#ifndef DIFF_BIT_PARALLEL_SLACK
+#   define DIFF_BIT_PARALLEL_SLACK (-3)
+#endif
+
+typedef struct DiffBox {
+    ptrdiff_t left, top, right, bottom; // [left, right) of `a`, [top, bottom) of `b`
+} DiffBox;
+
+// From (x0, y0) to (x1, y1): a diagonal run and at most one single step, which comes first if `step_first`
+typedef struct DiffSnake {
+    ptrdiff_t x0, y0, x1, y1;
+    bool step_first;
+} DiffSnake;
+
+typedef struct DiffTask {
+    bool is_snake;
+    union {
+        DiffBox box;
+        DiffSnake snake;
+    };
+} DiffTask;
+
+typedef struct DiffOps {
+    unsigned char* ops;
+    size_t count;
+} DiffOps;
+
+// Either the bytes of a string or interned token ids
+typedef struct DiffSeq {
+    const char* chars;
+    const uint32_t* ids;
+    size_t len;
+} DiffSeq;
+
+static DiffSeq diff_seq_from_sv(StringView sv) {
+    return (DiffSeq) { .chars = sv.data, .len = sv.len };
+}
+
+static inline bool diff_seq_equal(const DiffSeq* a, ptrdiff_t x, const DiffSeq* b, ptrdiff_t y) {
+    return a->ids != NULL ? a->ids[x] == b->ids[y] : a->chars[x] == b->chars[y];
+}
+
+static inline size_t diff_seq_symbol(const DiffSeq* seq, size_t i) {
+    return seq->ids != NULL ? seq->ids[i] : (unsigned char) seq->chars[i];
+}
+
+static DiffSeq diff_seq_slice(DiffSeq seq, size_t start, size_t end) {
+    return (DiffSeq) {
+        .chars = seq.chars != NULL ? seq.chars + start : NULL,
+        .ids = seq.ids != NULL ? seq.ids + start : NULL,
+        .len = end - start,
+    };
+}
+
+typedef struct DiffState {
+    DiffSeq a, b;
+    // indexed by diagonal k = x - y relative to the box, offset by `v_offset`
+    ptrdiff_t* vf; // furthest x reached going forwards
+    ptrdiff_t* vb; // furthest y reached going backwards, on diagonal k - delta
+    ptrdiff_t v_offset;
+} DiffState;
+
+// Gives up with false past `d_limit` edits from either end, a negative limit never does
+static bool find_middle_snake(DiffState* state, DiffBox box, ptrdiff_t d_limit, DiffSnake* out_snake) {
+    const DiffSeq* a = &state->a;
+    const DiffSeq* b = &state->b;
+    ptrdiff_t* vf = state->vf + state->v_offset;
+    ptrdiff_t* vb = state->vb + state->v_offset;
+
+    ptrdiff_t width = box.right - box.left, height = box.bottom - box.top;
+    ptrdiff_t delta = width - height;
+    ptrdiff_t max = (width + height + 1) / 2;
+    bool odd = (delta & 1) != 0;
+
+    vf[1] = box.left;
+    vb[1] = box.bottom;
 
-static void print_backtrack(StringView a, StringView b, int dp[a.len + 1][b.len + 1], size_t i, size_t j) {
-    if (i == 0 && j == 0)
-        return;
+    if (d_limit >= 0 && d_limit < max) max = d_limit;
 
-    if (i > 0 && j > 0 && a.data[i - 1] == b.data[j - 1]) {
-        print_backtrack(a, b, dp, i - 1, j - 1);
-        printf("%c", a.data[i - 1]);
-    } else if (j > 0 && (i == 0 || dp[i][j - 1] >= dp[i - 1][j])) {
-        print_backtrack(a, b, dp, i, j - 1);
-        printf(GREEN "%c" RESET, b.data[j - 1]);
-    } else if (i > 0) {
-        print_backtrack(a, b, dp, i - 1, j);
-        printf(RED "%c" RESET, a.data[i - 1]);
+    for (ptrdiff_t d = 0; d <= max; ++d) {
+        for (ptrdiff_t k = d; k >= -d; k -= 2) {
+            ptrdiff_t c = k - delta;
+            ptrdiff_t px, x;
+            if (k == -d || (k != d && vf[k - 1] < vf[k + 1])) {
+                px = x = vf[k + 1];
+            } else {
+                px = vf[k - 1];
+                x = px + 1;
+            }
+            ptrdiff_t y = box.top + (x - box.left) - k;
+            ptrdiff_t py = (d == 0 || x != px) ? y : y - 1;
+
+            while (x < box.right && y < box.bottom && diff_seq_equal(a, x, b, y)) {
+                x++;
+                y++;
+            }
+            vf[k] = x;
+
+            if (odd && c >= -(d - 1) && c <= d - 1 && y >= vb[c]) {
+                *out_snake = (DiffSnake) { .x0 = px, .y0 = py, .x1 = x, .y1 = y, .step_first = true };
+                return true;
+            }
+        }
+
+        for (ptrdiff_t c = d; c >= -d; c -= 2) {
+            ptrdiff_t k = c + delta;
+            ptrdiff_t py, y;
+            if (c == -d || (c != d && vb[c - 1] > vb[c + 1])) {
+                py = y = vb[c + 1];
+            } else {
+                py = vb[c - 1];
+                y = py - 1;
+            }
+            ptrdiff_t x = box.left + (y - box.top) + k;
+            ptrdiff_t px = (d == 0 || y != py) ? x : x + 1;
+
+            while (x > box.left && y > box.top && diff_seq_equal(a, x - 1, b, y - 1)) {
+                x--;
+                y--;
+            }
+            vb[c] = y;
+
+            if (!odd && k >= -d && k <= d && x <= vf[k]) {
+                *out_snake = (DiffSnake) { .x0 = x, .y0 = y, .x1 = px, .y1 = py, .step_first = false };
+                return true;
+            }
+        }
     }
+
+    return false;
 }
 
-void print_diff(StringView a, StringView b) {
-    int (*dp)[b.len + 1] = malloc(sizeof(int[a.len + 1][b.len + 1]));
-    if (dp == NULL) return;
-
-    for (size_t i = 0; i <= a.len; i++) {
-        for (size_t j = 0; j <= b.len; j++) {
-            if (i == 0 || j == 0) {
-                dp[i][j] = 0;
-            } else if (a.data[i - 1] == b.data[j - 1]) {
-                dp[i][j] = dp[i - 1][j - 1] + 1;
+static void push_ops(DiffOps* script, DiffOp op, ptrdiff_t count) {
+    for (ptrdiff_t i = 0; i < count; ++i) script->ops[script->count++] = (unsigned char) op;
+}
+
+static void push_snake_ops(DiffOps* script, DiffSnake snake) {
+    ptrdiff_t width = snake.x1 - snake.x0, height = snake.y1 - snake.y0;
+    ptrdiff_t diagonal = width < height ? width : height;
+    ptrdiff_t step = width == height ? 0 : 1;
+    DiffOp step_op = width > height ? DIFF_DELETE : DIFF_INSERT;
+
+    if (snake.step_first) push_ops(script, step_op, step);
+    push_ops(script, DIFF_EQUAL, diagonal);
+    if (!snake.step_first) push_ops(script, step_op, step);
+}
+
+typedef struct DiffStack {
+    DiffTask* tasks;
+    size_t count, cap;
+} DiffStack;
+
+static bool diff_stack_push(DiffStack* stack, DiffTask task) {
+    if (stack->count == stack->cap) {
+        size_t new_cap = stack->cap > 0 ? stack->cap * 2 : 64;
+        DiffTask* new_tasks = realloc(stack->tasks, new_cap * sizeof(DiffTask));
+        if (new_tasks == NULL) return false;
+
+        stack->tasks = new_tasks;
+        stack->cap = new_cap;
+    }
+    stack->tasks[stack->count++] = task;
+    return true;
+}
+
+typedef enum {
+    MYERS_DONE,
+    MYERS_OVER_LIMIT, // nothing was added to the script
+    MYERS_FAILED,
+} MyersResult;
+
+// Appends a shortest edit script turning `a` into `b`, giving up early if the top box takes more than `d_limit`
+static MyersResult myers_edit_script(DiffSeq a, DiffSeq b, ptrdiff_t d_limit, DiffOps* script) {
+    MyersResult result = MYERS_FAILED;
+    ptrdiff_t max = (ptrdiff_t) ((a.len + b.len + 1) / 2);
+    DiffState state = { .a = a, .b = b, .v_offset = max + 1 };
+    state.vf = malloc((size_t) (2 * max + 3) * sizeof(ptrdiff_t));
+    state.vb = malloc((size_t) (2 * max + 3) * sizeof(ptrdiff_t));
+    DiffStack stack = {0};
+    if (state.vf == NULL || state.vb == NULL) goto e1;
+
+    DiffTask root = { .is_snake = false, .box = { 0, 0, (ptrdiff_t) a.len, (ptrdiff_t) b.len } };
+    if (!diff_stack_push(&stack, root)) goto e1;
+
+    while (stack.count > 0) {
+        DiffTask task = stack.tasks[--stack.count];
+        if (task.is_snake) {
+            push_snake_ops(script, task.snake);
+            continue;
+        }
+
+        DiffBox box = task.box;
+        ptrdiff_t width = box.right - box.left, height = box.bottom - box.top;
+        if (width == 0 || height == 0) {
+            push_ops(script, DIFF_DELETE, width);
+            push_ops(script, DIFF_INSERT, height);
+            continue;
+        }
+
+        // the top box is the first one, the middle of every other one is at most half as far
+        DiffSnake snake;
+        if (!find_middle_snake(&state, box, d_limit, &snake)) {
+            result = MYERS_OVER_LIMIT;
+            goto e1;
+        }
+        d_limit = -1;
+
+        // popped in reverse: head box, snake, tail box
+        DiffTask tail = { .is_snake = false, .box = { snake.x1, snake.y1, box.right, box.bottom } };
+        DiffTask middle = { .is_snake = true, .snake = snake };
+        DiffTask head = { .is_snake = false, .box = { box.left, box.top, snake.x0, snake.y0 } };
+        if (!diff_stack_push(&stack, tail) || !diff_stack_push(&stack, middle) || !diff_stack_push(&stack, head)) goto e1;
+    }
+    result = MYERS_DONE;
+
+e1: free(stack.tasks);
+    free(state.vb);
+    free(state.vf);
+    return result;
+}
+
+static size_t count_set_bits_below(const uint64_t* row, size_t bit) {
+    size_t count = 0;
+    for (size_t w = 0; w < bit / 64; ++w) count += (size_t) __builtin_popcountll(row[w]);
+    if (bit % 64 != 0) count += (size_t) __builtin_popcountll(row[bit / 64] & ((1ull << (bit % 64)) - 1));
+    return count;
+}
+
+static bool bit_is_set(const uint64_t* row, size_t bit) {
+    return (row[bit / 64] >> (bit % 64)) & 1;
+}
+
+// Row i holds the LCS matrix row of a[0, i) against all of `b`, bit j is clear iff L[i][j + 1] = L[i][j] + 1.
+// Row 0 is all ones, each next one is V' = (V + (V & M)) | (V & ~M) with M the columns matching a[i].
+static uint64_t* bit_lcs_rows(DiffSeq a, DiffSeq b, size_t alphabet, size_t words) {
+    uint64_t* masks = calloc(alphabet * words, sizeof(uint64_t));
+    uint64_t* rows = malloc((a.len + 1) * words * sizeof(uint64_t));
+    if (masks == NULL || rows == NULL) goto e1;
+
+    for (size_t j = 0; j < b.len; ++j) {
+        masks[diff_seq_symbol(&b, j) * words + j / 64] |= 1ull << (j % 64);
+    }
+
+    memset(rows, 0xff, words * sizeof(uint64_t));
+    for (size_t i = 0; i < a.len; ++i) {
+        const uint64_t* v = rows + i * words;
+        const uint64_t* m = masks + diff_seq_symbol(&a, i) * words;
+        uint64_t* next = rows + (i + 1) * words;
+
+        // the carry ripples through the words in order, which is what keeps this one word at a time
+        uint64_t carry = 0;
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t u = v[w] & m[w];
+            uint64_t sum = v[w] + u;
+            uint64_t carry_out = sum < u;
+            sum += carry;
+            carry_out |= sum < carry;
+            carry = carry_out;
+            next[w] = sum | (v[w] & ~m[w]);
+        }
+    }
+
+    free(masks);
+    return rows;
+
+e1: free(rows);
+    free(masks);
+    return NULL;
+}
+
+// Walks the rows back from (a.len, b.len) with a running L[i][j] - L[i - 1][j], so every row is only
+// counted once when the walk reaches it and the traceback stays within O(n * m / 64 + n + m)
+static bool bit_lcs_edit_script(DiffSeq a, DiffSeq b, size_t alphabet, DiffOps* script) {
+    size_t words = (b.len + 63) / 64;
+    uint64_t* rows = bit_lcs_rows(a, b, alphabet, words);
+    if (rows == NULL) return false;
+
+    size_t lcs = b.len - count_set_bits_below(rows + a.len * words, b.len);
+    unsigned char* out = script->ops + script->count + a.len + b.len - lcs;
+    script->count += a.len + b.len - lcs;
+
+    size_t i = a.len, j = b.len;
+    while (i > 0 && j > 0) {
+        const uint64_t* row = rows + i * words;
+        const uint64_t* above = row - words;
+        ptrdiff_t gain = (ptrdiff_t) count_set_bits_below(above, j) - (ptrdiff_t) count_set_bits_below(row, j);
+
+        bool moved_up = false;
+        while (j > 0 && !moved_up) {
+            if (bit_is_set(row, j - 1)) {
+                // L[i][j] = L[i][j - 1], b[j - 1] is not part of this LCS
+                *--out = DIFF_INSERT;
+                gain -= (ptrdiff_t) bit_is_set(above, j - 1) - 1;
+                j--;
+            } else if (gain == 0) {
+                *--out = DIFF_DELETE;
+                moved_up = true;
             } else {
-                dp[i][j] = (dp[i - 1][j] > dp[i][j - 1])
-                            ? dp[i - 1][j]
-                            : dp[i][j - 1];
+                *--out = DIFF_EQUAL;
+                j--;
+                moved_up = true;
+            }
+        }
+        if (moved_up) i--;
+    }
+    while (i > 0) {
+        *--out = DIFF_DELETE;
+        i--;
+    }
+    while (j > 0) {
+        *--out = DIFF_INSERT;
+        j--;
+    }
+
+    free(rows);
+    return true;
+}
+
+// Fills `script->ops` (room for a.len + b.len ops) with a shortest edit script turning `a` into `b`,
+// whose symbols are all below `alphabet`
+static bool diff_seq_ops(DiffSeq a, DiffSeq b, size_t alphabet, DiffEngine engine, DiffOps* script) {
+    script->count = 0;
+
+    size_t prefix = 0;
+    while (prefix < a.len && prefix < b.len && diff_seq_equal(&a, (ptrdiff_t) prefix, &b, (ptrdiff_t) prefix)) prefix++;
+    size_t suffix = 0;
+    while (suffix < a.len - prefix && suffix < b.len - prefix
+            && diff_seq_equal(&a, (ptrdiff_t) (a.len - 1 - suffix), &b, (ptrdiff_t) (b.len - 1 - suffix))) {
+        suffix++;
+    }
+
+    push_ops(script, DIFF_EQUAL, (ptrdiff_t) prefix);
+    a = diff_seq_slice(a, prefix, a.len - suffix);
+    b = diff_seq_slice(b, prefix, b.len - suffix);
+
+    // Myers takes about D * (n + m) steps for D edits, the bit-parallel kernel a handful per word of every row
+    size_t words = (b.len + 63) / 64;
+    bool rows_fit = a.len > 0 && b.len > 0 && (a.len + 1 + alphabet) <= DIFF_BIT_PARALLEL_MAX_WORDS / words;
+    ptrdiff_t d_limit = -1;
+    if (rows_fit) {
+        d_limit = (ptrdiff_t) (DIFF_BIT_PARALLEL_WORD_COST * (a.len + 1) * words / (a.len + b.len)) + DIFF_BIT_PARALLEL_SLACK;
+        if (d_limit < 0) d_limit = 0;
+    }
+    if (engine == DIFF_ENGINE_MYERS) d_limit = -1;
+    if (engine == DIFF_ENGINE_BIT_PARALLEL && rows_fit) d_limit = 0;
+
+    MyersResult result = myers_edit_script(a, b, d_limit, script);
+    if (result == MYERS_OVER_LIMIT) {
+        if (!bit_lcs_edit_script(a, b, alphabet, script)) result = myers_edit_script(a, b, -1, script);
+        else result = MYERS_DONE;
+    }
+    if (result != MYERS_DONE) return false;
+
+    push_ops(script, DIFF_EQUAL, (ptrdiff_t) suffix);
+    return true;
+}
+
+static bool diff_ops(StringView a, StringView b, DiffEngine engine, DiffOps* script) {
+    return diff_seq_ops(diff_seq_from_sv(a), diff_seq_from_sv(b), 256, engine, script);
+}
+
+typedef struct DiffToken {
+    size_t start, len;
+} DiffToken;
+
+static bool is_word_byte(unsigned char c) {
+    return isalnum(c) || c == '_' || c >= 0x80;
+}
+
+// Words, numbers and identifiers (UTF-8 sequences included), runs of whitespace,
+// and every other byte on its own, which is what splits code into names and operators.
+// Only counts them without `out_tokens`.
+static size_t tokenize(StringView sv, DiffToken* out_tokens) {
+    size_t count = 0;
+    for (size_t i = 0; i < sv.len;) {
+        unsigned char c = (unsigned char) sv.data[i];
+        size_t end = i + 1;
+        if (is_word_byte(c)) {
+            while (end < sv.len && is_word_byte((unsigned char) sv.data[end])) end++;
+        } else if (isspace(c)) {
+            while (end < sv.len && isspace((unsigned char) sv.data[end])) end++;
+        }
+        if (out_tokens != NULL) out_tokens[count] = (DiffToken) { .start = i, .len = end - i };
+        count++;
+        i = end;
+    }
+    return count;
+}
+
+typedef struct TokenSlot {
+    const char* data; // NULL while the slot is free
+    size_t len;
+    uint64_t hash;
+    uint32_t id;
+} TokenSlot;
+
+// FNV-1a
+static uint64_t hash_token(const char* data, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Equal tokens of either string get the same id
+static void intern_tokens(StringView sv, const DiffToken* tokens, size_t count, TokenSlot* slots, size_t slots_mask, uint32_t* next_id, uint32_t* out_ids) {
+    for (size_t i = 0; i < count; ++i) {
+        const char* data = sv.data + tokens[i].start;
+        size_t len = tokens[i].len;
+        uint64_t hash = hash_token(data, len);
+
+        size_t slot = (size_t) hash & slots_mask;
+        while (slots[slot].data != NULL
+                && (slots[slot].hash != hash || slots[slot].len != len || memcmp(slots[slot].data, data, len) != 0)) {
+            slot = (slot + 1) & slots_mask;
+        }
+        if (slots[slot].data == NULL) {
+            slots[slot] = (TokenSlot) { .data = data, .len = len, .hash = hash, .id = (*next_id)++ };
+        }
+        out_ids[i] = slots[slot].id;
+    }
+}
+
+static StringView tokens_span(StringView sv, const DiffToken* tokens, size_t first, size_t count) {
+    return sv_slice(sv, tokens[first].start, tokens[first + count - 1].start + tokens[first + count - 1].len);
+}
+
+// Like diff_ops, but lining up whole tokens first and only diffing characters inside the changed ones
+static bool diff_ops_by_tokens(StringView a, StringView b, DiffEngine engine, DiffOps* script) {
+    bool ok = false;
+    script->count = 0;
+
+    size_t a_count = tokenize(a, NULL);
+    size_t b_count = tokenize(b, NULL);
+    size_t slots_count = 16;
+    while (slots_count < 2 * (a_count + b_count)) slots_count *= 2;
+
+    DiffToken* a_tokens = malloc((a_count + 1) * sizeof(DiffToken));
+    DiffToken* b_tokens = malloc((b_count + 1) * sizeof(DiffToken));
+    uint32_t* ids = malloc((a_count + b_count + 1) * sizeof(uint32_t));
+    TokenSlot* slots = calloc(slots_count, sizeof(TokenSlot));
+    DiffOps token_ops = { .ops = malloc(a_count + b_count + 1) };
+    if (a_tokens == NULL || b_tokens == NULL || ids == NULL || slots == NULL || token_ops.ops == NULL) goto e1;
+
+    tokenize(a, a_tokens);
+    tokenize(b, b_tokens);
+
+    uint32_t next_id = 0;
+    intern_tokens(a, a_tokens, a_count, slots, slots_count - 1, &next_id, ids);
+    intern_tokens(b, b_tokens, b_count, slots, slots_count - 1, &next_id, ids + a_count);
+
+    DiffSeq a_seq = { .ids = ids, .len = a_count };
+    DiffSeq b_seq = { .ids = ids + a_count, .len = b_count };
+    if (!diff_seq_ops(a_seq, b_seq, next_id, engine, &token_ops)) goto e1;
+
+    size_t x = 0, y = 0;
+    for (size_t i = 0; i < token_ops.count;) {
+        if (token_ops.ops[i] == DIFF_EQUAL) {
+            push_ops(script, DIFF_EQUAL, (ptrdiff_t) a_tokens[x].len);
+            x++;
+            y++;
+            i++;
+            continue;
+        }
+
+        size_t deleted = 0, inserted = 0;
+        for (; i < token_ops.count && token_ops.ops[i] != DIFF_EQUAL; ++i) {
+            if (token_ops.ops[i] == DIFF_DELETE) deleted++;
+            else inserted++;
+        }
+
+        // the changed tokens of either side are contiguous, so are their characters
+        StringView a_changed = deleted > 0 ? tokens_span(a, a_tokens, x, deleted) : SV("");
+        StringView b_changed = inserted > 0 ? tokens_span(b, b_tokens, y, inserted) : SV("");
+        DiffOps refined = { .ops = script->ops + script->count };
+        if (!diff_ops(a_changed, b_changed, engine, &refined)) goto e1;
+
+        // characters in common by chance inside otherwise different words are only noise
+        size_t kept = a_changed.len + b_changed.len - refined.count;
+        size_t shorter = a_changed.len < b_changed.len ? a_changed.len : b_changed.len;
+        if (2 * kept < shorter) {
+            refined.count = 0;
+            push_ops(&refined, DIFF_DELETE, (ptrdiff_t) a_changed.len);
+            push_ops(&refined, DIFF_INSERT, (ptrdiff_t) b_changed.len);
+        }
+        script->count += refined.count;
+
+        x += deleted;
+        y += inserted;
+    }
+    ok = true;
+
+e1: free(token_ops.ops);
+    free(slots);
+    free(ids);
+    free(b_tokens);
+    free(a_tokens);
+    return ok;
+}
+
+// Run-length encodes `ops`, moving the deletions of every change run ahead of its insertions
+static bool diff_spans(const DiffOps* ops, DiffEditScript* script) {
+    size_t spans_cap = 0;
+    for (size_t i = 0; i < ops->count; ++i) {
+        if (i == 0 || (ops->ops[i] == DIFF_EQUAL) != (ops->ops[i - 1] == DIFF_EQUAL)) spans_cap += 2;
+    }
+    script->spans = malloc((spans_cap > 0 ? spans_cap : 1) * sizeof(DiffSpan));
+    if (script->spans == NULL) return false;
+
+    for (size_t i = 0; i < ops->count;) {
+        size_t end = i;
+        size_t deleted = 0, inserted = 0, equal = 0;
+        if (ops->ops[i] == DIFF_EQUAL) {
+            while (end < ops->count && ops->ops[end] == DIFF_EQUAL) end++;
+            equal = end - i;
+        } else {
+            for (; end < ops->count && ops->ops[end] != DIFF_EQUAL; ++end) {
+                if (ops->ops[end] == DIFF_DELETE) deleted++;
+                else inserted++;
             }
         }
+
+        if (equal > 0)    script->spans[script->spans_count++] = (DiffSpan) { .op = DIFF_EQUAL,  .len = equal };
+        if (deleted > 0)  script->spans[script->spans_count++] = (DiffSpan) { .op = DIFF_DELETE, .len = deleted };
+        if (inserted > 0) script->spans[script->spans_count++] = (DiffSpan) { .op = DIFF_INSERT, .len = inserted };
+        script->deleted_count += deleted;
+        script->inserted_count += inserted;
+        i = end;
+    }
+    return true;
+}
+
+typedef bool (*DiffOpsFn)(StringView a, StringView b, DiffEngine engine, DiffOps* script);
+
+static DiffEditScript diff_edit_script_with(StringView a, StringView b, DiffEngine engine, DiffOpsFn ops_fn) {
+    DiffEditScript script = {0};
+    DiffOps ops = { .ops = malloc(a.len + b.len + 1) };
+    if (ops.ops == NULL) goto e1;
+    if (!ops_fn(a, b, engine, &ops)) goto e2;
+    if (!diff_spans(&ops, &script)) goto e2;
+
+    free(ops.ops);
+    return script;
+
+e2: free(ops.ops);
+e1: return DIFF_EDIT_SCRIPT_NULL;
+}
+
+DiffEditScript diff_edit_script(StringView a, StringView b) {
+    return diff_edit_script_with(a, b, DIFF_ENGINE_AUTO, diff_ops);
+}
+
+DiffEditScript diff_edit_script_by_tokens(StringView a, StringView b) {
+    return diff_edit_script_with(a, b, DIFF_ENGINE_AUTO, diff_ops_by_tokens);
+}
+
+DiffEditScript diff_edit_script_with_engine(StringView a, StringView b, DiffEngine engine) {
+    return diff_edit_script_with(a, b, engine, diff_ops);
+}
+
+void free_diff_edit_script(DiffEditScript* script) {
+    free(script->spans);
+    *script = DIFF_EDIT_SCRIPT_NULL;
+}
+
+DiffMistakes diff_count_mistakes(const DiffEditScript* script) {
+    DiffMistakes mistakes = {0};
+    for (size_t i = 0; i < script->spans_count; ++i) {
+        if (script->spans[i].op != DIFF_DELETE) continue;
+
+        size_t deleted = script->spans[i].len;
+        size_t inserted = i + 1 < script->spans_count && script->spans[i + 1].op == DIFF_INSERT ? script->spans[i + 1].len : 0;
+        size_t substituted = deleted < inserted ? deleted : inserted;
+        mistakes.substituted += substituted;
+        mistakes.missing += deleted - substituted;
+    }
+    mistakes.extra = script->inserted_count - mistakes.substituted;
+    return mistakes;
+}
+
+_Static_assert(sizeof(RED) == sizeof(GREEN), "both diff colours take the same room");
+
+bool render_diff(int fd, StringView a, StringView b, const DiffEditScript* script) {
+    // adjacent spans never share a colour, so every coloured span costs exactly one colour and one reset
+    size_t len = script->deleted_count + script->inserted_count + 1;
+    for (size_t i = 0; i < script->spans_count; ++i) {
+        if (script->spans[i].op == DIFF_EQUAL) len += script->spans[i].len;
+        else len += sizeof(RED) - 1 + sizeof(RESET) - 1;
+    }
+
+    char* buf = malloc(len);
+    if (buf == NULL) return false;
+
+    size_t pos = 0, x = 0, y = 0;
+    for (size_t i = 0; i < script->spans_count; ++i) {
+        DiffSpan span = script->spans[i];
+        if (span.op == DIFF_EQUAL) {
+            memcpy(buf + pos, a.data + x, span.len);
+            pos += span.len;
+            x += span.len;
+            y += span.len;
+            continue;
+        }
+
+        const char* color = span.op == DIFF_DELETE ? RED : GREEN;
+        const char* text = span.op == DIFF_DELETE ? a.data + x : b.data + y;
+        memcpy(buf + pos, color, sizeof(RED) - 1);
+        pos += sizeof(RED) - 1;
+        memcpy(buf + pos, text, span.len);
+        pos += span.len;
+        memcpy(buf + pos, RESET, sizeof(RESET) - 1);
+        pos += sizeof(RESET) - 1;
+
+        if (span.op == DIFF_DELETE) x += span.len;
+        else y += span.len;
     }
+    buf[pos++] = '\n';
 
-    print_backtrack(a, b, dp, a.len, b.len);
-    printf("\n");
+    fflush(stdout);
+    bool ok = true;
+    for (size_t written = 0; written < pos;) {
+        ssize_t n = write(fd, buf + written, pos - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        written += (size_t) n;
+    }
 
-    free(dp);
+    free(buf);
+    return ok;
 }
 
+void print_diff(StringView a, StringView b) {
+    DiffEditScript script = diff_edit_script(a, b);
+    if (diff_edit_script_is_null(&script)) return;
 
+    render_diff(STDOUT_FILENO, a, b, &script);
+    free_diff_edit_script(&script);
+}
@@ -1,64 +1,115 @@
 #include "generator-dataset.h"
 
 #include "sv.h"
-
-#include <stdio.h>
-#include <stdlib.h>
-
-void random_string(char* buf, size_t length, StringView charset) {
-    for (size_t i = 0; i < length; i++) {
-        int key = rand() % charset.len;
-        buf[i] = charset.data[key];
+#include "rng.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Charsets are padded to 64 entries so that every 6 bits of a random word pick a character,
+// chunks landing past the real characters are skipped to keep the choice uniform.
+typedef struct Charset {
+    char chars[64];
+    uint8_t len;
+} Charset;
+
+static const Charset alpha_numeric_charset = { "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789", 62 };
+static const Charset alpha_charset = { "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ", 52 };
+
+static void random_string(Rng* rng, char* buf, size_t length, const Charset* charset) {
+    size_t i = 0;
+    while (i < length) {
+        uint64_t bits = rng_next(rng);
+        for (int chunk = 0; chunk < 10 && i < length; ++chunk, bits >>= 6) {
+            uint8_t key = bits & 63;
+            if (key < charset->len) buf[i++] = charset->chars[key];
+        }
     }
-    buf[length] = '\0';
 }
 
 #define RANDOM_STRINGS_GENERATORS_MIN_LEN 3
 #define RANDOM_STRINGS_GENERATORS_MAX_LEN 13
-#define RANDOM_STRINGS_GENERATORS_GET_RAND_LEN() \
-    (rand() % (RANDOM_STRINGS_GENERATORS_MAX_LEN - RANDOM_STRINGS_GENERATORS_MIN_LEN) + RANDOM_STRINGS_GENERATORS_MIN_LEN)
-
-StringView random_alpha_numeric_strings_generator() {
-    static char buf[RANDOM_STRINGS_GENERATORS_MAX_LEN + 1];
-
-    size_t len = RANDOM_STRINGS_GENERATORS_GET_RAND_LEN();
-    random_string(buf, len, SV("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"));
-
-    return sv_from_data_and_len(buf, len);
+#define RANDOM_STRINGS_GENERATORS_GET_RAND_LEN(rng) \
+    (rng_below((rng), RANDOM_STRINGS_GENERATORS_MAX_LEN - RANDOM_STRINGS_GENERATORS_MIN_LEN) + RANDOM_STRINGS_GENERATORS_MIN_LEN)
+
+static size_t random_strings_batch(Rng* rng, const Charset* charset, char* arena, size_t arena_cap, StringView* out, size_t count) {
+    size_t used = 0, i = 0;
+    for (; i < count; ++i) {
+        size_t len = RANDOM_STRINGS_GENERATORS_GET_RAND_LEN(rng);
+        if (arena_cap - used < len) break;
+
+        random_string(rng, arena + used, len, charset);
+        out[i] = sv_from_data_and_len(arena + used, len);
+        used += len;
+    }
+    return i;
 }
 
-StringView random_alpha_strings_generator() {
-    static char buf[RANDOM_STRINGS_GENERATORS_MAX_LEN + 1];
-
-    size_t len = RANDOM_STRINGS_GENERATORS_GET_RAND_LEN();
-    random_string(buf, len, SV("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"));
+size_t random_alpha_numeric_strings_generator(const void* context, Rng* rng, char* arena, size_t arena_cap, StringView* out, size_t count) {
+    (void) context;
+    return random_strings_batch(rng, &alpha_numeric_charset, arena, arena_cap, out, count);
+}
 
-    return sv_from_data_and_len(buf, len);
+size_t random_alpha_strings_generator(const void* context, Rng* rng, char* arena, size_t arena_cap, StringView* out, size_t count) {
+    (void) context;
+    return random_strings_batch(rng, &alpha_charset, arena, arena_cap, out, count);
 }
 
 #define RANDOM_NUMBERS_GENERATORS_MIN_NUM 0
 #define RANDOM_NUMBERS_GENERATORS_MAX_NUM 9999999
-#define RANDOM_NUMBERS_GENERATORS_GET_RAND_NUM() \
-    (rand() % (RANDOM_NUMBERS_GENERATORS_MAX_NUM - RANDOM_NUMBERS_GENERATORS_MIN_NUM) + RANDOM_NUMBERS_GENERATORS_MIN_NUM)
+#define RANDOM_NUMBERS_GENERATORS_GET_RAND_NUM(rng) \
+    (rng_below((rng), RANDOM_NUMBERS_GENERATORS_MAX_NUM - RANDOM_NUMBERS_GENERATORS_MIN_NUM) + RANDOM_NUMBERS_GENERATORS_MIN_NUM)
+
+static const char digit_pairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Writes the decimal digits of `value` to `out`, which needs room for 10 of them
+static size_t format_uint32(char* out, uint32_t value) {
+    char digits[10];
+    size_t start = sizeof(digits);
+
+    while (value >= 100) {
+        start -= 2;
+        memcpy(digits + start, digit_pairs + 2 * (value % 100), 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        start -= 2;
+        memcpy(digits + start, digit_pairs + 2 * value, 2);
+    } else {
+        digits[--start] = (char) ('0' + value);
+    }
 
-StringView random_numbers_generator() {
-    static char buf[32];
+    memcpy(out, digits + start, sizeof(digits) - start);
+    return sizeof(digits) - start;
+}
 
-    int num = RANDOM_NUMBERS_GENERATORS_GET_RAND_NUM();
-    int len = snprintf(buf, sizeof(buf), "%d", num);
+size_t random_numbers_generator(const void* context, Rng* rng, char* arena, size_t arena_cap, StringView* out, size_t count) {
+    (void) context;
+    size_t used = 0, i = 0;
+    for (; i < count && arena_cap - used >= 10; ++i) {
+        uint32_t num = (uint32_t) RANDOM_NUMBERS_GENERATORS_GET_RAND_NUM(rng);
+        size_t len = format_uint32(arena + used, num);
 
-    return sv_from_data_and_len(buf, (size_t) len);
+        out[i] = sv_from_data_and_len(arena + used, len);
+        used += len;
+    }
+    return i;
 }
 
 GeneratorDataset random_alpha_numeric_strings_generator_dataset = {
-    .gen = random_alpha_numeric_strings_generator,
+    .gen_batch = random_alpha_numeric_strings_generator,
 };
 
 GeneratorDataset random_alpha_strings_generator_dataset = {
-    .gen = random_alpha_strings_generator,
+    .gen_batch = random_alpha_strings_generator,
 };
 
 GeneratorDataset random_numbers_generator_dataset = {
-    .gen = random_numbers_generator,
+    .gen_batch = random_numbers_generator,
 };
-
@@ -0,0 +1,136 @@
+#include "input-compare.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#   define INPUT_COMPARE_X86
+#   include <immintrin.h>
+#endif
+
+// Built from tolower and ispunct, so the tables agree with them in whatever locale is in effect
+static unsigned char fold_table[256];
+static bool punct_table[256];
+// Whether folding is exactly 'A'-'Z' to 'a'-'z', which is what the SIMD kernels do
+static bool fold_is_ascii;
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void build_tables(void) {
+    fold_is_ascii = true;
+    for (int c = 0; c < 256; ++c) {
+        fold_table[c] = (unsigned char) tolower(c);
+        punct_table[c] = ispunct(c) != 0;
+
+        int ascii_fold = c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+        if (fold_table[c] != ascii_fold) fold_is_ascii = false;
+    }
+}
+
+static bool eql_exact(StringView input, StringView expected) {
+    // libc's memcmp is already vectorized
+    return input.len == expected.len && memcmp(input.data, expected.data, input.len) == 0;
+}
+
+static bool eql_fold_portable(StringView input, StringView expected) {
+    if (input.len != expected.len) return false;
+
+    for (size_t i = 0; i < input.len; ++i) {
+        if (fold_table[(unsigned char) input.data[i]] != (unsigned char) expected.data[i]) return false;
+    }
+    return true;
+}
+
+#ifdef INPUT_COMPARE_X86
+
+// Only the input gets folded, the expected text already is. Bytes above 0x7f are negative
+// as signed chars, which keeps them out of the 'A'-'Z' range test.
+__attribute__((target("sse2")))
+static bool eql_fold_sse2(StringView input, StringView expected) {
+    if (input.len != expected.len) return false;
+
+    const __m128i upper_lo = _mm_set1_epi8('A' - 1), upper_hi = _mm_set1_epi8('Z' + 1), case_bit = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= input.len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (input.data + i));
+        __m128i is_upper = _mm_and_si128(_mm_cmpgt_epi8(x, upper_lo), _mm_cmplt_epi8(x, upper_hi));
+        __m128i folded = _mm_add_epi8(x, _mm_and_si128(is_upper, case_bit));
+        __m128i e = _mm_loadu_si128((const __m128i*) (expected.data + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(folded, e)) != 0xffff) return false;
+    }
+    return eql_fold_portable(sv_slice(input, i, input.len), sv_slice(expected, i, expected.len));
+}
+
+__attribute__((target("avx2")))
+static bool eql_fold_avx2(StringView input, StringView expected) {
+    if (input.len != expected.len) return false;
+
+    const __m256i upper_lo = _mm256_set1_epi8('A' - 1), upper_hi = _mm256_set1_epi8('Z' + 1), case_bit = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= input.len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*) (input.data + i));
+        __m256i is_upper = _mm256_and_si256(_mm256_cmpgt_epi8(x, upper_lo), _mm256_cmpgt_epi8(upper_hi, x));
+        __m256i folded = _mm256_add_epi8(x, _mm256_and_si256(is_upper, case_bit));
+        __m256i e = _mm256_loadu_si256((const __m256i*) (expected.data + i));
+        if ((uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(folded, e)) != 0xffffffffu) return false;
+    }
+    return eql_fold_portable(sv_slice(input, i, input.len), sv_slice(expected, i, expected.len));
+}
+
+#endif // INPUT_COMPARE_X86
+
+// `fold` is a constant in each caller, so both variants come out without the test in the loop
+static inline bool eql_skipping_punct(StringView input, StringView expected, bool fold) {
+    size_t j = 0;
+    for (size_t i = 0; i < input.len; ++i) {
+        unsigned char c = (unsigned char) input.data[i];
+        if (punct_table[c]) continue;
+
+        if (j == expected.len) return false;
+        if ((fold ? fold_table[c] : c) != (unsigned char) expected.data[j]) return false;
+        j++;
+    }
+    return j == expected.len;
+}
+
+static bool eql_punct(StringView input, StringView expected) {
+    return eql_skipping_punct(input, expected, false);
+}
+
+static bool eql_punct_fold(StringView input, StringView expected) {
+    return eql_skipping_punct(input, expected, true);
+}
+
+static InputEqlFn select_fold_eql(void) {
+    if (!fold_is_ascii) return eql_fold_portable;
+
+#ifdef INPUT_COMPARE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return eql_fold_avx2;
+    if (__builtin_cpu_supports("sse2")) return eql_fold_sse2;
+#endif
+    return eql_fold_portable;
+}
+
+InputComparator input_comparator(bool ignore_case, bool ignore_punctuations) {
+    pthread_once(&tables_once, build_tables);
+
+    InputComparator comparator = { .ignore_case = ignore_case, .ignore_punctuations = ignore_punctuations };
+    if (ignore_punctuations) {
+        comparator.eql = ignore_case ? eql_punct_fold : eql_punct;
+    } else {
+        comparator.eql = ignore_case ? select_fold_eql() : eql_exact;
+    }
+    return comparator;
+}
+
+size_t input_comparator_normalize(const InputComparator* comparator, StringView expected, char* out) {
+    size_t len = 0;
+    for (size_t i = 0; i < expected.len; ++i) {
+        unsigned char c = (unsigned char) expected.data[i];
+        if (comparator->ignore_punctuations && punct_table[c]) continue;
+        out[len++] = (char) (comparator->ignore_case ? fold_table[c] : c);
+    }
+    return len;
+}
@@ -0,0 +1,130 @@
+#include "line-scan.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#   define LINE_SCAN_X86
+#   include <immintrin.h>
+#endif
+
+typedef size_t (*ScanLineEndsFn)(StringView content, size_t* io_from, size_t* out_ends, size_t out_cap);
+typedef size_t (*CountLineEndsFn)(StringView content);
+
+static size_t scan_line_ends_portable(StringView content, size_t* io_from, size_t* out_ends, size_t out_cap) {
+    size_t from = *io_from, count = 0;
+
+    while (count < out_cap) {
+        const char* nl = memchr(content.data + from, '\n', content.len - from);
+        if (nl == NULL) {
+            from = content.len;
+            break;
+        }
+
+        size_t end = (size_t) (nl - content.data);
+        out_ends[count++] = end;
+        from = end + 1;
+    }
+
+    *io_from = from;
+    return count;
+}
+
+static size_t count_line_ends_portable(StringView content) {
+    size_t count = 0;
+    const char* p = content.data;
+    const char* end = content.data + content.len;
+    while ((p = memchr(p, '\n', (size_t) (end - p))) != NULL) {
+        count++;
+        p++;
+    }
+    return count;
+}
+
+#ifdef LINE_SCAN_X86
+
+// Scans 64 bytes per iteration: MASK64 returns a bitmask of the newlines in the block,
+// which is then turned into offsets one set bit at a time.
+#define DEFINE_SIMD_SCAN_LINE_ENDS(NAME, TARGET, MASK64)                                          \
+    __attribute__((target(TARGET)))                                                              \
+    static size_t NAME(StringView content, size_t* io_from, size_t* out_ends, size_t out_cap) {   \
+        size_t from = *io_from, count = 0;                                                       \
+        while (from + 64 <= content.len && out_cap - count >= 64) {                              \
+            uint64_t mask = MASK64(content.data + from);                                         \
+            while (mask != 0) {                                                                  \
+                out_ends[count++] = from + (size_t) __builtin_ctzll(mask);                       \
+                mask &= mask - 1;                                                                \
+            }                                                                                    \
+            from += 64;                                                                          \
+        }                                                                                        \
+        *io_from = from;                                                                         \
+        return count + scan_line_ends_portable(content, io_from, out_ends + count, out_cap - count); \
+    }
+
+#define DEFINE_SIMD_COUNT_LINE_ENDS(NAME, TARGET, MASK64)                                         \
+    __attribute__((target(TARGET)))                                                              \
+    static size_t NAME(StringView content) {                                                     \
+        size_t count = 0, i = 0;                                                                 \
+        for (; i + 64 <= content.len; i += 64) {                                                 \
+            count += (size_t) __builtin_popcountll(MASK64(content.data + i));                    \
+        }                                                                                        \
+        return count + count_line_ends_portable(sv_slice(content, i, content.len));              \
+    }
+
+__attribute__((target("sse2")))
+static inline uint64_t newline_mask64_sse2(const char* p) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    uint64_t m0 = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p +  0)), nl));
+    uint64_t m1 = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + 16)), nl));
+    uint64_t m2 = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + 32)), nl));
+    uint64_t m3 = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + 48)), nl));
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t newline_mask64_avx2(const char* p) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    uint64_t lo = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (p +  0)), nl));
+    uint64_t hi = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (p + 32)), nl));
+    return lo | (hi << 32);
+}
+
+DEFINE_SIMD_SCAN_LINE_ENDS(scan_line_ends_sse2, "sse2", newline_mask64_sse2)
+DEFINE_SIMD_SCAN_LINE_ENDS(scan_line_ends_avx2, "avx2", newline_mask64_avx2)
+DEFINE_SIMD_COUNT_LINE_ENDS(count_line_ends_sse2, "sse2,popcnt", newline_mask64_sse2)
+DEFINE_SIMD_COUNT_LINE_ENDS(count_line_ends_avx2, "avx2,popcnt", newline_mask64_avx2)
+
+#endif // LINE_SCAN_X86
+
+static ScanLineEndsFn scan_line_ends_impl = scan_line_ends_portable;
+static CountLineEndsFn count_line_ends_impl = count_line_ends_portable;
+static pthread_once_t line_scan_impl_once = PTHREAD_ONCE_INIT;
+
+static void select_line_scan_impl(void) {
+#ifdef LINE_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_line_ends_impl = scan_line_ends_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_line_ends_impl = scan_line_ends_sse2;
+    }
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        count_line_ends_impl = count_line_ends_avx2;
+    } else if (__builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt")) {
+        count_line_ends_impl = count_line_ends_sse2;
+    }
+#endif
+}
+
+size_t scan_line_ends(StringView content, size_t* io_from, size_t* out_ends, size_t out_cap) {
+    pthread_once(&line_scan_impl_once, select_line_scan_impl);
+    return scan_line_ends_impl(content, io_from, out_ends, out_cap);
+}
+
+size_t count_line_ends(StringView content) {
+    pthread_once(&line_scan_impl_once, select_line_scan_impl);
+    return count_line_ends_impl(content);
+}
+
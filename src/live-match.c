@@ -0,0 +1,57 @@
+#include "live-match.h"
+
+#include <ctype.h>
+
+static bool live_match_skips(const LiveMatch* match, char c) {
+    return match->ignore_punctuations && ispunct((unsigned char) c);
+}
+
+static char live_match_fold(const LiveMatch* match, char c) {
+    return match->ignore_case ? (char) tolower((unsigned char) c) : c;
+}
+
+// Keeps `expected_pos` on a significant byte, so that a trailing run of punctuation never has to be typed
+static void live_match_skip_expected(LiveMatch* match) {
+    while (match->expected_pos < match->expected.len && live_match_skips(match, match->expected.data[match->expected_pos])) {
+        match->expected_pos++;
+    }
+}
+
+LiveMatch live_match_start(StringView expected, bool ignore_case, bool ignore_punctuations) {
+    LiveMatch match = {
+        .expected = expected,
+        .ignore_case = ignore_case,
+        .ignore_punctuations = ignore_punctuations,
+    };
+    live_match_skip_expected(&match);
+    return match;
+}
+
+LiveCell live_match_push(LiveMatch* match, char c) {
+    if (live_match_skips(match, c)) return LIVE_CELL_IGNORED;
+
+    if (match->expected_pos == match->expected.len) {
+        match->excess_count++;
+        return LIVE_CELL_INCORRECT;
+    }
+
+    bool correct = live_match_fold(match, c) == live_match_fold(match, match->expected.data[match->expected_pos]);
+    match->expected_pos++;
+    live_match_skip_expected(match);
+    return correct ? LIVE_CELL_CORRECT : LIVE_CELL_INCORRECT;
+}
+
+void live_match_pop(LiveMatch* match, char c) {
+    if (live_match_skips(match, c)) return;
+
+    // excess bytes always come last
+    if (match->excess_count > 0) {
+        match->excess_count--;
+        return;
+    }
+
+    while (match->expected_pos > 0 && live_match_skips(match, match->expected.data[match->expected_pos - 1])) {
+        match->expected_pos--;
+    }
+    match->expected_pos--;
+}
@@ -0,0 +1,324 @@
+#include "markov-generator.h"
+
+#include "sv.h"
+#include "rng.h"
+#include "dataset.h"
+#include "generator-dataset.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Symbols are bytes, 0 stands both for the padding before the first character and for the end of a word.
+// A context is the last `order` symbols packed into an integer, a transition is its context shifted
+// left by one byte with the next symbol in the low byte. Elements holding a 0 byte are skipped.
+#define MARKOV_END 0
+
+// Flat tables in a single allocation: the model header, then every array it points at
+typedef struct MarkovModel {
+    size_t order;
+    uint64_t context_mask;
+
+    // open addressing from a context to its index + 1, 0 marks an empty slot
+    const uint32_t* context_slots;
+    uint64_t context_slots_mask;
+
+    const uint64_t* contexts;
+    // transitions of context i are [transition_starts[i], transition_starts[i + 1])
+    const uint32_t* transition_starts;
+    const uint8_t* next_symbols;
+    // running total of the transition counts within each context
+    const uint32_t* cumulative_counts;
+} MarkovModel;
+
+#define MARKOV_MIN_WORD_LEN 3
+#define MARKOV_MAX_ATTEMPTS 16
+
+static inline uint64_t markov_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return key;
+}
+
+static inline const uint32_t* markov_find_context(const MarkovModel* model, uint64_t context) {
+    for (uint64_t slot = markov_hash(context) & model->context_slots_mask; ; slot = (slot + 1) & model->context_slots_mask) {
+        uint32_t entry = model->context_slots[slot];
+        if (entry == 0) return NULL;
+        if (model->contexts[entry - 1] == context) return &model->transition_starts[entry - 1];
+    }
+}
+
+// Picks the next symbol in O(log alphabet), or MARKOV_END if the context was never seen
+static inline uint8_t markov_next_symbol(const MarkovModel* model, uint64_t context, Rng* rng) {
+    const uint32_t* starts = markov_find_context(model, context);
+    if (starts == NULL) return MARKOV_END;
+
+    uint32_t lo = starts[0], hi = starts[1] - 1;
+    uint32_t preceding = lo == 0 ? 0 : model->cumulative_counts[lo - 1];
+    uint64_t target = preceding + rng_below(rng, model->cumulative_counts[hi] - preceding);
+
+    // first transition whose running total exceeds the target
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (model->cumulative_counts[mid] > target) hi = mid;
+        else lo = mid + 1;
+    }
+    return model->next_symbols[lo];
+}
+
+static size_t markov_word(const MarkovModel* model, Rng* rng, char* out) {
+    size_t len = 0;
+    for (int attempt = 0; attempt < MARKOV_MAX_ATTEMPTS; ++attempt) {
+        uint64_t context = 0;
+        len = 0;
+
+        uint8_t symbol;
+        while (len < GENERATOR_DATASET_MAX_LEN && (symbol = markov_next_symbol(model, context, rng)) != MARKOV_END) {
+            out[len++] = (char) symbol;
+            context = ((context << 8) | symbol) & model->context_mask;
+        }
+
+        bool ended = len < GENERATOR_DATASET_MAX_LEN;
+        if (ended && len >= MARKOV_MIN_WORD_LEN) break;
+    }
+    return len;
+}
+
+static size_t markov_gen_batch(const void* context, Rng* rng, char* arena, size_t arena_cap, StringView* out, size_t count) {
+    const MarkovModel* model = context;
+
+    size_t used = 0, i = 0;
+    for (; i < count && arena_cap - used >= GENERATOR_DATASET_MAX_LEN; ++i) {
+        size_t len = markov_word(model, rng, arena + used);
+        out[i] = sv_from_data_and_len(arena + used, len);
+        used += len;
+    }
+    return i;
+}
+
+// Transition counts, open addressing with 0 as the empty key (a transition out of the
+// all-padding context into MARKOV_END would be an empty element, and those are skipped)
+typedef struct TransitionCounts {
+    uint64_t* keys;
+    uint32_t* counts;
+    size_t len;
+    uint64_t mask;
+} TransitionCounts;
+
+static bool init_transition_counts(TransitionCounts* table, size_t cap) {
+    table->keys = calloc(cap, sizeof(uint64_t));
+    table->counts = calloc(cap, sizeof(uint32_t));
+    table->len = 0;
+    table->mask = cap - 1;
+    if (table->keys == NULL || table->counts == NULL) {
+        free(table->keys);
+        free(table->counts);
+        table->keys = NULL;
+        table->counts = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void free_transition_counts(TransitionCounts* table) {
+    free(table->keys);
+    free(table->counts);
+}
+
+static bool add_transition(TransitionCounts* table, uint64_t key, uint32_t count) {
+    if (2 * (table->len + 1) > table->mask + 1) {
+        TransitionCounts grown;
+        if (!init_transition_counts(&grown, 2 * (table->mask + 1))) return false;
+        for (size_t i = 0; i <= table->mask; ++i) {
+            if (table->keys[i] != 0) add_transition(&grown, table->keys[i], table->counts[i]);
+        }
+        free_transition_counts(table);
+        *table = grown;
+    }
+
+    uint64_t slot = markov_hash(key) & table->mask;
+    while (table->keys[slot] != 0 && table->keys[slot] != key) slot = (slot + 1) & table->mask;
+
+    if (table->keys[slot] == 0) {
+        table->keys[slot] = key;
+        table->len++;
+    }
+    table->counts[slot] += count;
+    return true;
+}
+
+#define MARKOV_TRAIN_MIN_CHUNK_ELEMENTS 16384
+#define MARKOV_TRAIN_MAX_THREADS        64
+
+typedef struct TrainChunk {
+    pthread_t thread;
+    bool thread_started;
+
+    DataSet* dataset;
+    size_t from, to;
+    uint64_t context_mask;
+
+    TransitionCounts counts;
+    bool ok;
+} TrainChunk;
+
+static void* train_chunk(void* arg) {
+    TrainChunk* chunk = arg;
+    chunk->ok = init_transition_counts(&chunk->counts, 4096);
+
+    for (size_t i = chunk->from; i < chunk->to && chunk->ok; ++i) {
+        StringView element = dataset_element(chunk->dataset, i);
+        if (element.len == 0 || memchr(element.data, MARKOV_END, element.len) != NULL) continue;
+
+        uint64_t context = 0;
+        for (size_t j = 0; j < element.len && chunk->ok; ++j) {
+            uint8_t symbol = (uint8_t) element.data[j];
+            chunk->ok = add_transition(&chunk->counts, (context << 8) | symbol, 1);
+            context = ((context << 8) | symbol) & chunk->context_mask;
+        }
+        chunk->ok = chunk->ok && add_transition(&chunk->counts, context << 8 | MARKOV_END, 1);
+    }
+    return NULL;
+}
+
+static int compare_transitions(const void* lhs, const void* rhs) {
+    uint64_t a = *(const uint64_t*) lhs, b = *(const uint64_t*) rhs;
+    return (a > b) - (a < b);
+}
+
+// Sorting the transitions groups them by context, each context's run then becomes a slice of the flat arrays
+static MarkovModel* build_markov_model(TransitionCounts* merged, size_t order, uint64_t context_mask) {
+    size_t transitions_count = merged->len;
+    if (transitions_count == 0 || transitions_count > UINT32_MAX) return NULL;
+
+    uint64_t* transitions = malloc(transitions_count * sizeof(uint64_t));
+    if (transitions == NULL) return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i <= merged->mask; ++i) {
+        if (merged->keys[i] != 0) transitions[n++] = merged->keys[i];
+    }
+    qsort(transitions, transitions_count, sizeof(uint64_t), compare_transitions);
+
+    size_t contexts_count = 0;
+    for (size_t i = 0; i < transitions_count; ++i) {
+        if (i == 0 || (transitions[i] >> 8) != (transitions[i - 1] >> 8)) contexts_count++;
+    }
+
+    uint64_t slots_count = 1;
+    while (slots_count < 2 * contexts_count) slots_count *= 2;
+
+    size_t size = sizeof(MarkovModel)
+                + contexts_count * sizeof(uint64_t)
+                + transitions_count * sizeof(uint32_t)
+                + (contexts_count + 1) * sizeof(uint32_t)
+                + slots_count * sizeof(uint32_t)
+                + transitions_count * sizeof(uint8_t);
+    char* block = calloc(1, size);
+    if (block == NULL) {
+        free(transitions);
+        return NULL;
+    }
+
+    MarkovModel* model = (MarkovModel*) block;
+    uint64_t* contexts = (uint64_t*) (block + sizeof(MarkovModel));
+    uint32_t* cumulative_counts = (uint32_t*) (contexts + contexts_count);
+    uint32_t* transition_starts = cumulative_counts + transitions_count;
+    uint32_t* context_slots = transition_starts + contexts_count + 1;
+    uint8_t* next_symbols = (uint8_t*) (context_slots + slots_count);
+
+    uint32_t running_total = 0;
+    size_t context_index = 0;
+    for (size_t i = 0; i < transitions_count; ++i) {
+        uint64_t context = transitions[i] >> 8;
+        if (i == 0 || context != (transitions[i - 1] >> 8)) {
+            contexts[context_index] = context;
+            transition_starts[context_index] = (uint32_t) i;
+            context_index++;
+            running_total = 0;
+        }
+
+        uint64_t slot = markov_hash(transitions[i]) & merged->mask;
+        while (merged->keys[slot] != transitions[i]) slot = (slot + 1) & merged->mask;
+
+        running_total += merged->counts[slot];
+        cumulative_counts[i] = running_total;
+        next_symbols[i] = (uint8_t) transitions[i];
+    }
+    transition_starts[contexts_count] = (uint32_t) transitions_count;
+
+    for (size_t i = 0; i < contexts_count; ++i) {
+        uint64_t slot = markov_hash(contexts[i]) & (slots_count - 1);
+        while (context_slots[slot] != 0) slot = (slot + 1) & (slots_count - 1);
+        context_slots[slot] = (uint32_t) (i + 1);
+    }
+
+    free(transitions);
+    *model = (MarkovModel) {
+        .order = order,
+        .context_mask = context_mask,
+        .context_slots = context_slots,
+        .context_slots_mask = slots_count - 1,
+        .contexts = contexts,
+        .transition_starts = transition_starts,
+        .next_symbols = next_symbols,
+        .cumulative_counts = cumulative_counts,
+    };
+    return model;
+}
+
+GeneratorDataset train_markov_generator_dataset(DataSet* dataset, size_t order, size_t threads) {
+    if (order == 0 || order > MARKOV_MAX_ORDER) return GENERATOR_DATASET_NULL;
+    uint64_t context_mask = ((uint64_t) 1 << (8 * order)) - 1;
+
+    dataset_wait_index(dataset);
+    size_t elements_count = dataset->elements_count;
+
+    if (threads == 0) threads = dataset_default_index_threads();
+    if (threads > MARKOV_TRAIN_MAX_THREADS) threads = MARKOV_TRAIN_MAX_THREADS;
+    if (threads > elements_count / MARKOV_TRAIN_MIN_CHUNK_ELEMENTS) threads = elements_count / MARKOV_TRAIN_MIN_CHUNK_ELEMENTS;
+    if (threads == 0) threads = 1;
+
+    TrainChunk chunks[MARKOV_TRAIN_MAX_THREADS] = {0};
+    for (size_t i = 0; i < threads; ++i) {
+        chunks[i] = (TrainChunk) {
+            .dataset = dataset,
+            .from = elements_count * i / threads,
+            .to = elements_count * (i + 1) / threads,
+            .context_mask = context_mask,
+        };
+    }
+
+    for (size_t i = 1; i < threads; ++i) {
+        chunks[i].thread_started = pthread_create(&chunks[i].thread, NULL, train_chunk, &chunks[i]) == 0;
+    }
+    train_chunk(&chunks[0]);
+    for (size_t i = 1; i < threads; ++i) {
+        if (chunks[i].thread_started) {
+            pthread_join(chunks[i].thread, NULL);
+        } else {
+            train_chunk(&chunks[i]);
+        }
+    }
+
+    // the first chunk's table absorbs the others
+    bool ok = true;
+    for (size_t i = 0; i < threads; ++i) ok = ok && chunks[i].ok;
+    for (size_t i = 1; i < threads && ok; ++i) {
+        TransitionCounts* counts = &chunks[i].counts;
+        for (size_t slot = 0; slot <= counts->mask && ok; ++slot) {
+            if (counts->keys[slot] != 0) ok = add_transition(&chunks[0].counts, counts->keys[slot], counts->counts[slot]);
+        }
+    }
+
+    MarkovModel* model = ok ? build_markov_model(&chunks[0].counts, order, context_mask) : NULL;
+    for (size_t i = 0; i < threads; ++i) {
+        free_transition_counts(&chunks[i].counts);
+    }
+    if (model == NULL) return GENERATOR_DATASET_NULL;
+
+    return (GeneratorDataset) { .gen_batch = markov_gen_batch, .context = model, ._context_owned = model };
+}
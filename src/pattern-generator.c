@@ -0,0 +1,329 @@
+#include "pattern-generator.h"
+
+#include "sv.h"
+#include "rng.h"
+#include "generator-dataset.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    PATTERN_OP_LITERAL, // copy `len` bytes from the pool
+    PATTERN_OP_CLASS,   // pick one of `len` bytes from the pool
+} PatternOp;
+
+typedef struct PatternInstr {
+    uint8_t op;
+    uint8_t class_bits; // random bits needed to index the class, indexes past `len` are redrawn
+    uint16_t min, max;  // repetitions
+    uint32_t arg;       // offset into the pool
+    uint32_t len;
+} PatternInstr;
+
+// Lives in a single allocation: the header, then the instructions, then the pool of literals and class tables
+typedef struct PatternProgram {
+    const PatternInstr* instrs;
+    size_t instrs_count;
+    const char* pool;
+    size_t max_len;
+} PatternProgram;
+
+#define PATTERN_PRINTABLE_FIRST '!'
+#define PATTERN_PRINTABLE_LAST  '~'
+
+static size_t pattern_gen_batch(const void* context, Rng* rng, char* arena, size_t arena_cap, StringView* out, size_t count) {
+    const PatternProgram* program = context;
+    const PatternInstr* instrs_end = program->instrs + program->instrs_count;
+
+    uint64_t bits = 0;
+    unsigned bits_left = 0;
+
+    size_t used = 0, i = 0;
+    for (; i < count && arena_cap - used >= program->max_len; ++i) {
+        char* start = arena + used;
+        char* p = start;
+
+        for (const PatternInstr* instr = program->instrs; instr < instrs_end; ++instr) {
+            size_t reps = instr->min;
+            if (instr->max > instr->min) reps += (size_t) rng_below(rng, (uint64_t) (instr->max - instr->min) + 1);
+
+            const char* bytes = program->pool + instr->arg;
+            if (instr->op == PATTERN_OP_LITERAL) {
+                for (size_t r = 0; r < reps; ++r, p += instr->len) {
+                    memcpy(p, bytes, instr->len);
+                }
+                continue;
+            }
+
+            unsigned class_bits = instr->class_bits;
+            uint64_t mask = ((uint64_t) 1 << class_bits) - 1;
+            for (size_t r = 0; r < reps; ++r) {
+                uint64_t index;
+                do {
+                    if (bits_left < class_bits) {
+                        bits = rng_next(rng);
+                        bits_left = 64;
+                    }
+                    index = bits & mask;
+                    bits >>= class_bits;
+                    bits_left -= class_bits;
+                } while (index >= instr->len);
+
+                *p++ = bytes[index];
+            }
+        }
+
+        out[i] = sv_from_data_and_len(start, (size_t) (p - start));
+        used += (size_t) (p - start);
+    }
+    return i;
+}
+
+typedef struct PatternCompiler {
+    StringView pattern;
+    size_t pos;
+
+    PatternInstr* instrs;
+    size_t instrs_count, instrs_cap;
+    char* pool;
+    size_t pool_len, pool_cap;
+    size_t min_len, max_len;
+
+    const char* error;
+    size_t error_pos;
+} PatternCompiler;
+
+static bool pattern_error(PatternCompiler* compiler, const char* error) {
+    compiler->error = error;
+    compiler->error_pos = compiler->pos;
+    return false;
+}
+
+static bool pattern_push_instr(PatternCompiler* compiler, PatternInstr instr) {
+    if (compiler->instrs_count == compiler->instrs_cap) {
+        size_t new_cap = compiler->instrs_cap == 0 ? 8 : compiler->instrs_cap * 2;
+        PatternInstr* instrs = realloc(compiler->instrs, new_cap * sizeof(PatternInstr));
+        if (instrs == NULL) return pattern_error(compiler, "out of memory");
+
+        compiler->instrs = instrs;
+        compiler->instrs_cap = new_cap;
+    }
+    compiler->instrs[compiler->instrs_count++] = instr;
+    return true;
+}
+
+static bool pattern_push_bytes(PatternCompiler* compiler, const char* bytes, size_t len) {
+    if (compiler->pool_len + len > compiler->pool_cap) {
+        size_t new_cap = compiler->pool_cap == 0 ? 64 : compiler->pool_cap;
+        while (new_cap < compiler->pool_len + len) new_cap *= 2;
+
+        char* pool = realloc(compiler->pool, new_cap);
+        if (pool == NULL) return pattern_error(compiler, "out of memory");
+
+        compiler->pool = pool;
+        compiler->pool_cap = new_cap;
+    }
+    memcpy(compiler->pool + compiler->pool_len, bytes, len);
+    compiler->pool_len += len;
+    return true;
+}
+
+static inline bool pattern_at_end(PatternCompiler* compiler) {
+    return compiler->pos == compiler->pattern.len;
+}
+
+static inline char pattern_peek(PatternCompiler* compiler) {
+    return compiler->pattern.data[compiler->pos];
+}
+
+static bool pattern_parse_number(PatternCompiler* compiler, uint16_t* out) {
+    size_t value = 0, digits = 0;
+    while (!pattern_at_end(compiler) && pattern_peek(compiler) >= '0' && pattern_peek(compiler) <= '9') {
+        value = value * 10 + (size_t) (pattern_peek(compiler) - '0');
+        if (value > GENERATOR_DATASET_MAX_LEN) return pattern_error(compiler, "repetition count too large");
+        compiler->pos++;
+        digits++;
+    }
+    if (digits == 0) return pattern_error(compiler, "expected a number");
+
+    *out = (uint16_t) value;
+    return true;
+}
+
+static bool pattern_parse_quantifier(PatternCompiler* compiler, uint16_t* out_min, uint16_t* out_max) {
+    *out_min = *out_max = 1;
+    if (pattern_at_end(compiler)) return true;
+
+    if (pattern_peek(compiler) == '?') {
+        compiler->pos++;
+        *out_min = 0;
+        return true;
+    }
+    if (pattern_peek(compiler) != '{') return true;
+
+    compiler->pos++;
+    if (!pattern_parse_number(compiler, out_min)) return false;
+    *out_max = *out_min;
+
+    if (!pattern_at_end(compiler) && pattern_peek(compiler) == ',') {
+        compiler->pos++;
+        if (!pattern_parse_number(compiler, out_max)) return false;
+        if (*out_max < *out_min) return pattern_error(compiler, "repetition range is reversed");
+    }
+
+    if (pattern_at_end(compiler) || pattern_peek(compiler) != '}') return pattern_error(compiler, "expected '}'");
+    compiler->pos++;
+    return true;
+}
+
+// Parses the inside of `[...]`, the opening bracket already consumed
+static bool pattern_parse_class(PatternCompiler* compiler, bool members[256]) {
+    bool negated = !pattern_at_end(compiler) && pattern_peek(compiler) == '^';
+    if (negated) compiler->pos++;
+
+    bool any = false;
+    while (!pattern_at_end(compiler) && pattern_peek(compiler) != ']') {
+        unsigned char first = (unsigned char) pattern_peek(compiler);
+        if (first == '\\') {
+            compiler->pos++;
+            if (pattern_at_end(compiler)) return pattern_error(compiler, "dangling '\\'");
+            first = (unsigned char) pattern_peek(compiler);
+        }
+        compiler->pos++;
+
+        unsigned char last = first;
+        if (compiler->pos + 1 < compiler->pattern.len && pattern_peek(compiler) == '-' && compiler->pattern.data[compiler->pos + 1] != ']') {
+            compiler->pos++;
+            last = (unsigned char) pattern_peek(compiler);
+            if (last == '\\') {
+                compiler->pos++;
+                if (pattern_at_end(compiler)) return pattern_error(compiler, "dangling '\\'");
+                last = (unsigned char) pattern_peek(compiler);
+            }
+            if (last < first) return pattern_error(compiler, "character range is reversed");
+            compiler->pos++;
+        }
+
+        for (unsigned c = first; c <= last; ++c) members[c] = true;
+        any = true;
+    }
+
+    if (pattern_at_end(compiler)) return pattern_error(compiler, "expected ']'");
+    compiler->pos++;
+    if (!any) return pattern_error(compiler, "empty character class");
+
+    if (negated) {
+        for (unsigned c = 0; c < 256; ++c) {
+            members[c] = !members[c] && c >= PATTERN_PRINTABLE_FIRST && c <= PATTERN_PRINTABLE_LAST;
+        }
+    }
+    return true;
+}
+
+static bool pattern_push_class(PatternCompiler* compiler, const bool members[256], uint16_t min, uint16_t max) {
+    char chars[256];
+    uint32_t len = 0;
+    for (unsigned c = 0; c < 256; ++c) {
+        if (members[c]) chars[len++] = (char) c;
+    }
+    if (len == 0) return pattern_error(compiler, "character class matches nothing");
+
+    uint8_t class_bits = 0;
+    while (((uint32_t) 1 << class_bits) < len) class_bits++;
+
+    PatternInstr instr = { .op = PATTERN_OP_CLASS, .class_bits = class_bits, .min = min, .max = max, .arg = (uint32_t) compiler->pool_len, .len = len };
+    if (!pattern_push_bytes(compiler, chars, len)) return false;
+    compiler->min_len += min;
+    compiler->max_len += max;
+    return pattern_push_instr(compiler, instr);
+}
+
+static bool pattern_push_literal(PatternCompiler* compiler, char c, uint16_t min, uint16_t max) {
+    compiler->min_len += min;
+    compiler->max_len += max;
+
+    // a run of single literals becomes one copy
+    PatternInstr* last = compiler->instrs_count > 0 ? &compiler->instrs[compiler->instrs_count - 1] : NULL;
+    bool extends_last = last != NULL && last->op == PATTERN_OP_LITERAL && last->min == 1 && last->max == 1
+                     && last->arg + last->len == compiler->pool_len;
+    if (min == 1 && max == 1 && extends_last) {
+        last->len++;
+        return pattern_push_bytes(compiler, &c, 1);
+    }
+
+    PatternInstr instr = { .op = PATTERN_OP_LITERAL, .min = min, .max = max, .arg = (uint32_t) compiler->pool_len, .len = 1 };
+    if (!pattern_push_bytes(compiler, &c, 1)) return false;
+    return pattern_push_instr(compiler, instr);
+}
+
+static bool pattern_compile(PatternCompiler* compiler) {
+    while (!pattern_at_end(compiler)) {
+        char c = pattern_peek(compiler);
+        compiler->pos++;
+
+        bool members[256] = {0};
+        bool is_class = false;
+
+        if (c == '[') {
+            if (!pattern_parse_class(compiler, members)) return false;
+            is_class = true;
+        } else if (c == '.') {
+            for (unsigned m = PATTERN_PRINTABLE_FIRST; m <= PATTERN_PRINTABLE_LAST; ++m) members[m] = true;
+            is_class = true;
+        } else if (c == '\\') {
+            if (pattern_at_end(compiler)) return pattern_error(compiler, "dangling '\\'");
+            c = pattern_peek(compiler);
+            compiler->pos++;
+        } else if (c == '{' || c == '}' || c == '?' || c == ']') {
+            compiler->pos--;
+            return pattern_error(compiler, "nothing to repeat, escape it with '\\'");
+        }
+
+        uint16_t min, max;
+        if (!pattern_parse_quantifier(compiler, &min, &max)) return false;
+
+        bool pushed = is_class
+            ? pattern_push_class(compiler, members, min, max)
+            : pattern_push_literal(compiler, c, min, max);
+        if (!pushed) return false;
+
+        if (compiler->max_len > GENERATOR_DATASET_MAX_LEN) return pattern_error(compiler, "pattern can produce too long prompts");
+    }
+
+    // an empty prompt shows up as a blank line that cannot be typed meaningfully
+    if (compiler->min_len == 0) return pattern_error(compiler, "pattern can produce empty prompts");
+    return true;
+}
+
+GeneratorDataset compile_pattern_generator_dataset(StringView pattern, const char** out_error, size_t* out_error_pos) {
+    PatternCompiler compiler = { .pattern = pattern };
+    GeneratorDataset result = GENERATOR_DATASET_NULL;
+
+    if (!pattern_compile(&compiler)) goto e1;
+
+    size_t instrs_size = compiler.instrs_count * sizeof(PatternInstr);
+    char* block = malloc(sizeof(PatternProgram) + instrs_size + compiler.pool_len);
+    if (block == NULL) {
+        pattern_error(&compiler, "out of memory");
+        goto e1;
+    }
+
+    PatternProgram* program = (PatternProgram*) block;
+    PatternInstr* instrs = (PatternInstr*) (block + sizeof(PatternProgram));
+    char* pool = block + sizeof(PatternProgram) + instrs_size;
+    if (instrs_size > 0) memcpy(instrs, compiler.instrs, instrs_size);
+    if (compiler.pool_len > 0) memcpy(pool, compiler.pool, compiler.pool_len);
+
+    *program = (PatternProgram) { .instrs = instrs, .instrs_count = compiler.instrs_count, .pool = pool, .max_len = compiler.max_len };
+    result = (GeneratorDataset) { .gen_batch = pattern_gen_batch, .context = program, ._context_owned = program };
+
+e1: free(compiler.instrs);
+    free(compiler.pool);
+    if (generator_dataset_is_null(&result)) {
+        if (out_error != NULL) *out_error = compiler.error;
+        if (out_error_pos != NULL) *out_error_pos = compiler.error_pos;
+    }
+    return result;
+}
@@ -0,0 +1,153 @@
+#include "prompt-queue.h"
+
+#include "ansi.h"
+#include "datasets-utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PROMPT_RENDER_PREFIX BOLD "Type \""
+#define PROMPT_RENDER_SUFFIX "\"" RESET "\n"
+
+static StringView normalize_prompt_text(StringView text) {
+    // lines of CRLF files keep their '\r', which can never be typed
+    while (text.len > 0 && text.data[text.len - 1] == '\r') text.len--;
+    return text;
+}
+
+#define PROMPT_RENDER_PREFIX_LEN (sizeof(PROMPT_RENDER_PREFIX) - 1)
+#define PROMPT_RENDER_SUFFIX_LEN (sizeof(PROMPT_RENDER_SUFFIX) - 1)
+
+// Makes room for the render of a `text_len` long prompt followed by the comparator's normalized text,
+// which is never longer than the text itself
+static bool reserve_prompt(Prompt* prompt, size_t text_len) {
+    size_t buf_len = PROMPT_RENDER_PREFIX_LEN + 2 * text_len + PROMPT_RENDER_SUFFIX_LEN;
+    if (buf_len <= prompt->_cap) return true;
+
+    char* buf = realloc(prompt->_buf, buf_len);
+    if (buf == NULL) return false;
+
+    prompt->_buf = buf;
+    prompt->_cap = buf_len;
+    return true;
+}
+
+static void fill_prompt(Prompt* prompt, DataSetsSampler* sampler, Rng* rng, const InputComparator* comparator) {
+    prompt->no_repeat_position = sampler->no_repeat_position;
+    StringView text = normalize_prompt_text(random_element(sampler, rng));
+
+    size_t prefix_len = PROMPT_RENDER_PREFIX_LEN, suffix_len = PROMPT_RENDER_SUFFIX_LEN;
+    if (!reserve_prompt(prompt, text.len)) {
+        // an empty prompt rather than a torn one
+        text.len = 0;
+    }
+    size_t render_len = prefix_len + text.len + suffix_len;
+
+    char* out = prompt->_buf;
+    if (out == NULL) {
+        prompt->text = SV("");
+        prompt->expected = SV("");
+        prompt->render = SV(PROMPT_RENDER_PREFIX PROMPT_RENDER_SUFFIX);
+        return;
+    }
+
+    memcpy(out, PROMPT_RENDER_PREFIX, prefix_len);
+    if (text.len > 0) memcpy(out + prefix_len, text.data, text.len);
+    memcpy(out + prefix_len + text.len, PROMPT_RENDER_SUFFIX, suffix_len);
+
+    prompt->text = sv_from_data_and_len(out + prefix_len, text.len);
+    prompt->render = sv_from_data_and_len(out, render_len);
+
+    char* expected = out + render_len;
+    prompt->expected = sv_from_data_and_len(expected, input_comparator_normalize(comparator, prompt->text, expected));
+}
+
+static void* prompt_queue_worker(void* arg) {
+    PromptQueue* queue = arg;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (true) {
+        while (!queue->stopping && queue->written - queue->released == PROMPT_QUEUE_CAPACITY) {
+            pthread_cond_wait(&queue->freed, &queue->mutex);
+        }
+        if (queue->stopping) break;
+
+        Prompt* slot = &queue->slots[queue->written % PROMPT_QUEUE_CAPACITY];
+        pthread_mutex_unlock(&queue->mutex);
+
+        fill_prompt(slot, queue->sampler, queue->rng, &queue->comparator);
+
+        pthread_mutex_lock(&queue->mutex);
+        queue->written++;
+        pthread_cond_signal(&queue->filled);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return NULL;
+}
+
+bool init_prompt_queue(PromptQueue* queue, DataSetsSampler* sampler, Rng* rng, InputComparator comparator, size_t longest_text_len) {
+    memset(queue, 0, sizeof(*queue));
+    queue->sampler = sampler;
+    queue->rng = rng;
+    queue->comparator = comparator;
+
+    for (size_t i = 0; i < PROMPT_QUEUE_CAPACITY; ++i) {
+        if (!reserve_prompt(&queue->slots[i], longest_text_len)) goto e1;
+    }
+
+    if (pthread_mutex_init(&queue->mutex, NULL) != 0) goto e1;
+    if (pthread_cond_init(&queue->filled, NULL) != 0) goto e2;
+    if (pthread_cond_init(&queue->freed, NULL) != 0) goto e3;
+
+    queue->has_worker = pthread_create(&queue->worker, NULL, prompt_queue_worker, queue) == 0;
+    return true;
+
+e3: pthread_cond_destroy(&queue->filled);
+e2: pthread_mutex_destroy(&queue->mutex);
+e1: for (size_t i = 0; i < PROMPT_QUEUE_CAPACITY; ++i) {
+        free(queue->slots[i]._buf);
+    }
+    return false;
+}
+
+void free_prompt_queue(PromptQueue* queue) {
+    if (queue->has_worker) {
+        pthread_mutex_lock(&queue->mutex);
+        queue->stopping = true;
+        pthread_cond_signal(&queue->freed);
+        pthread_mutex_unlock(&queue->mutex);
+
+        pthread_join(queue->worker, NULL);
+    }
+
+    for (size_t i = 0; i < PROMPT_QUEUE_CAPACITY; ++i) {
+        free(queue->slots[i]._buf);
+    }
+    pthread_cond_destroy(&queue->freed);
+    pthread_cond_destroy(&queue->filled);
+    pthread_mutex_destroy(&queue->mutex);
+}
+
+const Prompt* prompt_queue_next(PromptQueue* queue) {
+    if (!queue->has_worker) {
+        // the slot just handed out is the only one ever in use
+        queue->released = queue->read;
+        Prompt* slot = &queue->slots[queue->read++ % PROMPT_QUEUE_CAPACITY];
+        fill_prompt(slot, queue->sampler, queue->rng, &queue->comparator);
+        queue->written = queue->read;
+        return slot;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->released != queue->read) {
+        queue->released = queue->read;
+        pthread_cond_signal(&queue->freed);
+    }
+    while (queue->written == queue->read) {
+        pthread_cond_wait(&queue->filled, &queue->mutex);
+    }
+    Prompt* slot = &queue->slots[queue->read++ % PROMPT_QUEUE_CAPACITY];
+    pthread_mutex_unlock(&queue->mutex);
+
+    return slot;
+}
@@ -0,0 +1,228 @@
+#include "terminal-input.h"
+
+#include "timespan.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+static TerminalInput* restore_at_exit;
+static bool restore_at_exit_registered;
+
+static void restore_terminal_at_exit(void) {
+    if (restore_at_exit != NULL) terminal_input_restore(restore_at_exit);
+}
+
+static void bump_eventfd(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+}
+
+static void drain_fd(int fd) {
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) > 0) {}
+}
+
+// Escape sequences arrive within a single read, so only the rest of `buf` is swallowed
+static size_t skip_escape_sequence(const char* buf, size_t len, size_t pos) {
+    if (pos == len) return pos;
+
+    char introducer = buf[pos];
+    if (introducer != '[' && introducer != 'O') return pos;
+    pos++;
+
+    while (pos < len) {
+        unsigned char c = (unsigned char) buf[pos++];
+        if (c >= 0x40 && c <= 0x7e) break;
+    }
+    return pos;
+}
+
+static KeyEvent classify_key(const char* buf, size_t len, size_t* pos, uint64_t time_ns) {
+    char byte = buf[(*pos)++];
+
+    KeyEvent event = { .time_ns = time_ns, .byte = byte, .kind = KEY_EVENT_CHAR };
+    switch (byte) {
+    case '\r': case '\n':
+        event.kind = KEY_EVENT_ENTER;
+        break;
+    case 0x7f: case '\b':
+        event.kind = KEY_EVENT_ERASE;
+        break;
+    case 0x03: case 0x04:
+        event.kind = KEY_EVENT_INTERRUPT;
+        break;
+    case 0x1b:
+        *pos = skip_escape_sequence(buf, len, *pos);
+        event.kind = KEY_EVENT_IGNORED;
+        break;
+    default:
+        if ((unsigned char) byte < 0x20 && byte != '\t') event.kind = KEY_EVENT_IGNORED;
+        break;
+    }
+    return event;
+}
+
+// Only a consumer stuck elsewhere for a thousand keystrokes fills the ring, the reader then
+// checks back every millisecond, still answering a stop request right away
+static bool push_key_event(TerminalInput* input, KeyEvent event) {
+    while (!key_ring_push(&input->ring, event)) {
+        bump_eventfd(input->wake_fd);
+        struct pollfd stop = { .fd = input->stop_fd, .events = POLLIN };
+        if (poll(&stop, 1, 1) > 0) return false;
+    }
+    return true;
+}
+
+static void* terminal_reader_run(void* arg) {
+    TerminalInput* input = arg;
+
+    char buf[TERMINAL_INPUT_READ_SIZE];
+    struct pollfd fds[2] = {
+        { .fd = input->fd, .events = POLLIN },
+        { .fd = input->stop_fd, .events = POLLIN },
+    };
+    while (true) {
+        int ready = poll(fds, 2, -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0 || fds[1].revents) break;
+
+        ssize_t len = read(input->fd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+
+        // every byte of one read is stamped with the time it returned
+        uint64_t time_ns = now_ns();
+        bool stopped = false;
+        for (size_t pos = 0; pos < (size_t) len && !stopped;) {
+            stopped = !push_key_event(input, classify_key(buf, (size_t) len, &pos, time_ns));
+        }
+        bump_eventfd(input->wake_fd);
+        if (stopped) break;
+    }
+
+    atomic_store_explicit(&input->closed, true, memory_order_release);
+    bump_eventfd(input->wake_fd);
+    return NULL;
+}
+
+static void close_terminal_fds(TerminalInput* input) {
+    if (input->wake_fd >= 0) close(input->wake_fd);
+    if (input->stop_fd >= 0) close(input->stop_fd);
+    if (input->timer_fd >= 0) close(input->timer_fd);
+    input->wake_fd = input->stop_fd = input->timer_fd = -1;
+}
+
+bool terminal_input_enable_raw(TerminalInput* input, int fd) {
+    input->fd = fd;
+    input->raw = false;
+    input->wake_fd = input->stop_fd = input->timer_fd = -1;
+    input->deadline_ns = 0;
+    input->has_held = false;
+    atomic_init(&input->ring.head, 0);
+    atomic_init(&input->ring.tail, 0);
+    atomic_init(&input->closed, false);
+    if (!isatty(fd) || tcgetattr(fd, &input->saved) != 0) return false;
+
+    input->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    input->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    input->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (input->wake_fd < 0 || input->stop_fd < 0 || input->timer_fd < 0) goto e1;
+
+    struct termios raw = input->saved;
+    raw.c_iflag &= ~(tcflag_t) (ICRNL | IXON);
+    // ISIG is off too, Ctrl-C arrives as a key so that the terminal is always restored
+    raw.c_lflag &= ~(tcflag_t) (ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSAFLUSH, &raw) != 0) goto e1;
+
+    if (pthread_create(&input->reader, NULL, terminal_reader_run, input) != 0) goto e2;
+
+    input->raw = true;
+    restore_at_exit = input;
+    if (!restore_at_exit_registered) {
+        restore_at_exit_registered = atexit(restore_terminal_at_exit) == 0;
+    }
+    return true;
+
+e2:
+    tcsetattr(fd, TCSAFLUSH, &input->saved);
+e1:
+    close_terminal_fds(input);
+    return false;
+}
+
+void terminal_input_restore(TerminalInput* input) {
+    if (!input->raw) return;
+
+    bump_eventfd(input->stop_fd);
+    pthread_join(input->reader, NULL);
+
+    tcsetattr(input->fd, TCSAFLUSH, &input->saved);
+    close_terminal_fds(input);
+    input->raw = false;
+    if (restore_at_exit == input) restore_at_exit = NULL;
+}
+
+bool terminal_input_set_deadline(TerminalInput* input, uint64_t deadline_ns) {
+    if (input->timer_fd < 0) return false;
+
+    // an all-zero it_value disarms the timer, a deadline already past fires right away
+    struct itimerspec spec = {
+        .it_value = { .tv_sec = (time_t) (deadline_ns / 1000000000ull), .tv_nsec = (long) (deadline_ns % 1000000000ull) },
+    };
+
+    // a stale expiration from the previous deadline must not wake anyone for the new one
+    drain_fd(input->timer_fd);
+
+    input->deadline_ns = deadline_ns;
+    return timerfd_settime(input->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0;
+}
+
+// Stamped with the deadline itself, however late the consumer got to it
+static KeyEvent take_deadline(TerminalInput* input) {
+    KeyEvent event = { .time_ns = input->deadline_ns, .kind = KEY_EVENT_DEADLINE };
+    terminal_input_set_deadline(input, 0);
+    return event;
+}
+
+bool terminal_read_key(TerminalInput* input, KeyEvent* out_event) {
+    if (!input->raw) return false;
+
+    struct pollfd fds[2] = {
+        { .fd = input->wake_fd, .events = POLLIN },
+        { .fd = input->timer_fd, .events = POLLIN },
+    };
+    while (true) {
+        // `closed` is published after the last push, so an empty ring seen after it stays empty
+        bool closed = atomic_load_explicit(&input->closed, memory_order_acquire);
+        if (!input->has_held) input->has_held = key_ring_pop(&input->ring, &input->held);
+
+        if (input->has_held) {
+            if (input->deadline_ns != 0 && input->held.time_ns >= input->deadline_ns) {
+                *out_event = take_deadline(input);
+                return true;
+            }
+            input->has_held = false;
+            *out_event = input->held;
+            return true;
+        }
+        if (input->deadline_ns != 0 && now_ns() >= input->deadline_ns) {
+            *out_event = take_deadline(input);
+            return true;
+        }
+        if (closed) return false;
+
+        int ready = poll(fds, 2, -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) return false;
+
+        if (fds[0].revents & POLLIN) drain_fd(input->wake_fd);
+        if (fds[1].revents & POLLIN) drain_fd(input->timer_fd);
+    }
+}
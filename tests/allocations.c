@@ -0,0 +1,262 @@
+#define _GNU_SOURCE // for posix_openpt, grantpt, unlockpt, ptsname
+
+#include "app.h"               // for TpvApp, tpv_read_line
+#include "builtin-datasets.h"  // for builtin_datasets
+#include "dataset.h"           // for DataSet, dataset_from_compressed_blocks, dataset_longest_element_len
+#include "datasets-utils.h"    // for DataSetsSampler, init_datasets_sampler
+#include "generator-dataset.h" // for GeneratorDataset, generator_dataset_gen_batch
+#include "input-compare.h"     // for input_comparator
+#include "markov-generator.h"  // for train_markov_generator_dataset
+#include "pattern-generator.h" // for compile_pattern_generator_dataset
+#include "prompt-queue.h"      // for PromptQueue, prompt_queue_next
+#include "terminal-input.h"    // for terminal_input_enable_raw, terminal_input_restore
+
+#include <fcntl.h>     // for open, O_WRONLY, O_RDWR, O_NOCTTY
+#include <stdatomic.h> // for atomic_size_t
+#include <stdio.h>     // for printf, fflush
+#include <stdlib.h>    // for malloc, free, posix_openpt
+#include <string.h>    // for strlen
+#include <unistd.h>    // for pipe, dup, dup2, write, close
+
+// Every malloc, calloc and realloc of the process goes through these, on any thread
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static atomic_size_t allocations_count;
+
+void* malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations_count, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocations_count, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    atomic_fetch_add_explicit(&allocations_count, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+#define WARM_UP_ROUNDS 1024
+#define MEASURED_ROUNDS 100000
+#define READ_LINES_COUNT 2000
+// few enough for all of them to fit the pseudo terminal's input buffer at once
+#define READ_RAW_LINES_COUNT 100
+
+static int failures_count = 0;
+
+static void expect_no_allocations(const char* what, size_t allocated) {
+    if (allocated == 0) {
+        printf("ok   %s\n", what);
+    } else {
+        printf("FAIL %s: %zu allocations in steady state\n", what, allocated);
+        failures_count++;
+    }
+}
+
+static void check_generator(const char* name, GeneratorDataset* gd) {
+    static char arena[GENERATOR_BATCH_SIZE * GENERATOR_DATASET_MAX_LEN];
+    StringView out[GENERATOR_BATCH_SIZE];
+
+    seed_generator_dataset(gd, 1);
+    for (size_t i = 0; i < WARM_UP_ROUNDS; ++i) {
+        generator_dataset_gen_batch(gd, arena, sizeof arena, out, GENERATOR_BATCH_SIZE);
+    }
+
+    size_t before = atomic_load(&allocations_count);
+    for (size_t i = 0; i < MEASURED_ROUNDS / GENERATOR_BATCH_SIZE; ++i) {
+        generator_dataset_gen_batch(gd, arena, sizeof arena, out, GENERATOR_BATCH_SIZE);
+    }
+    expect_no_allocations(name, atomic_load(&allocations_count) - before);
+}
+
+static void check_prompt_queue(DataSet* dataset, GeneratorDataset* generators, size_t generators_count) {
+    DataSetsSampler sampler = init_datasets_sampler(dataset, NULL, 1, generators, NULL, generators_count, 0.3);
+    if (datasets_sampler_is_null(&sampler)) {
+        printf("FAIL could not set up the sampler\n");
+        failures_count++;
+        return;
+    }
+
+    Rng rng = rng_from_seed(1);
+    PromptQueue queue;
+    size_t longest_len = dataset_longest_element_len(dataset);
+    if (longest_len < GENERATOR_DATASET_MAX_LEN) longest_len = GENERATOR_DATASET_MAX_LEN;
+    if (!init_prompt_queue(&queue, &sampler, &rng, input_comparator(true, true), longest_len)) {
+        printf("FAIL could not start the prompt queue\n");
+        failures_count++;
+        free_datasets_sampler(&sampler);
+        return;
+    }
+
+    for (size_t i = 0; i < WARM_UP_ROUNDS; ++i) prompt_queue_next(&queue);
+
+    size_t before = atomic_load(&allocations_count);
+    for (size_t i = 0; i < MEASURED_ROUNDS; ++i) prompt_queue_next(&queue);
+    expect_no_allocations("drawing prompts through the prompt queue", atomic_load(&allocations_count) - before);
+
+    free_prompt_queue(&queue);
+    free_datasets_sampler(&sampler);
+}
+
+// Lines read without a terminal, the path raw mode falls back to
+static void check_read_line(void) {
+    int fds[2];
+    if (pipe(fds) != 0) return;
+
+    static const char line[] = "the quick brown fox\n";
+    for (size_t i = 0; i < READ_LINES_COUNT; ++i) {
+        if (write(fds[1], line, sizeof line - 1) != (ssize_t) (sizeof line - 1)) return;
+    }
+    close(fds[1]);
+
+    fflush(stdout);
+    int saved_stdin = dup(STDIN_FILENO), saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(fds[0], STDIN_FILENO);
+    dup2(null_fd, STDOUT_FILENO);
+    close(fds[0]);
+    close(null_fd);
+
+    TpvApp app = {0};
+    app.line_cap = GENERATOR_DATASET_MAX_LEN + LINE_INPUT_BUF_SLACK;
+    app.line_buf = malloc(app.line_cap);
+    Prompt prompt = { .text = SV("the quick brown fox"), .render = SV("Type \"the quick brown fox\"\n") };
+
+    // stdio sets its buffers up on first use
+    for (size_t i = 0; i < READ_LINES_COUNT / 2; ++i) tpv_read_line(&app, ">>> ", &prompt);
+
+    size_t before = atomic_load(&allocations_count), read_count = 0;
+    while (!tpv_read_line(&app, ">>> ", &prompt).interrupted) read_count++;
+    size_t allocated = atomic_load(&allocations_count) - before;
+
+    fflush(stdout);
+    dup2(saved_stdin, STDIN_FILENO);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdin);
+    close(saved_stdout);
+    clearerr(stdin);
+    free(app.line_buf);
+
+    if (read_count != READ_LINES_COUNT / 2) {
+        printf("FAIL read %zu lines instead of %d\n", read_count, READ_LINES_COUNT / 2);
+        failures_count++;
+    }
+    expect_no_allocations("reading lines into the shared line buffer", allocated);
+}
+
+static bool type_lines(int master_fd, const char* line, size_t count) {
+    size_t len = strlen(line);
+    for (size_t i = 0; i < count; ++i) {
+        if (write(master_fd, line, len) != (ssize_t) len) return false;
+    }
+    return true;
+}
+
+// Lines read key by key in raw mode, with the live colouring on
+static void check_read_raw_line(void) {
+    int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+        printf("skip no pseudo terminal available\n");
+        return;
+    }
+    int slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+    if (slave_fd < 0) {
+        printf("skip no pseudo terminal available\n");
+        close(master_fd);
+        return;
+    }
+
+    TpvApp app = {0};
+    app.line_cap = GENERATOR_DATASET_MAX_LEN + LINE_INPUT_BUF_SLACK;
+    app.line_buf = malloc(app.line_cap);
+    app.key_events.events = malloc(KEY_EVENTS_CAPACITY * sizeof(KeyEvent));
+    app.args.live.set = true;
+    app.args.live.value = true;
+    if (!terminal_input_enable_raw(&app.terminal, slave_fd)) {
+        printf("FAIL could not switch the pseudo terminal to raw mode\n");
+        failures_count++;
+        goto e1;
+    }
+
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    Prompt prompt = { .text = SV("the quick brown fox"), .render = SV("Type \"the quick brown fox\"\n") };
+    size_t allocated = 0, read_count = 0;
+    if (type_lines(master_fd, "the quick brwn\x7fown fox\r", READ_RAW_LINES_COUNT)) {
+        for (size_t i = 0; i < READ_RAW_LINES_COUNT; ++i) tpv_read_line(&app, ">>> ", &prompt);
+    }
+    if (type_lines(master_fd, "the quick brwn\x7fown fox\r", READ_RAW_LINES_COUNT)) {
+        size_t before = atomic_load(&allocations_count);
+        for (; read_count < READ_RAW_LINES_COUNT; ++read_count) {
+            if (tpv_read_line(&app, ">>> ", &prompt).interrupted) break;
+        }
+        allocated = atomic_load(&allocations_count) - before;
+    }
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    terminal_input_restore(&app.terminal);
+
+    if (read_count != READ_RAW_LINES_COUNT) {
+        printf("FAIL read %zu raw lines instead of %d\n", read_count, READ_RAW_LINES_COUNT);
+        failures_count++;
+    }
+    expect_no_allocations("reading raw lines key by key", allocated);
+
+e1: free(app.key_events.events);
+    free(app.line_buf);
+    close(slave_fd);
+    close(master_fd);
+}
+
+// Lines of the fixture below, for builds that embed no built-in dataset at all
+#define FIXTURE_LINES_COUNT 12
+static const char fixture[] =
+    "the\nquick\nbrown\nfox\njumps\nover\nthe\nlazy\ndog\nwhile\nwe\ntype\n";
+static uint32_t fixture_line_ends[FIXTURE_LINES_COUNT];
+
+static DataSet any_dataset(void) {
+    for (size_t i = 0; i < builtin_datasets_count; ++i) {
+        DataSet dataset = dataset_from_compressed_blocks(builtin_datasets[i].blocks);
+        if (!dataset_is_null(&dataset)) return dataset;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < sizeof fixture - 1 && count < FIXTURE_LINES_COUNT; ++i) {
+        if (fixture[i] == '\n') fixture_line_ends[count++] = (uint32_t) i;
+    }
+    return dataset_from_line_ends(sv_from_data_and_len(fixture, sizeof fixture - 1), fixture_line_ends, sizeof(uint32_t), count);
+}
+
+int main(void) {
+    check_generator("random alpha strings generator", &random_alpha_strings_generator_dataset);
+    check_generator("random alpha numeric strings generator", &random_alpha_numeric_strings_generator_dataset);
+    check_generator("random numbers generator", &random_numbers_generator_dataset);
+
+    GeneratorDataset pattern = compile_pattern_generator_dataset(SV("[a-z]{3,8}[0-9]{2}"), NULL, NULL);
+    check_generator("pattern generator", &pattern);
+
+    DataSet words = any_dataset();
+    GeneratorDataset markov = train_markov_generator_dataset(&words, MARKOV_DEFAULT_ORDER, 1);
+    check_generator("markov generator", &markov);
+
+    GeneratorDataset generators[] = { random_alpha_strings_generator_dataset, pattern, markov };
+    check_prompt_queue(&words, generators, sizeof generators / sizeof generators[0]);
+
+    check_read_line();
+    check_read_raw_line();
+
+    free_generator_dataset(&markov);
+    free_generator_dataset(&pattern);
+    free_dataset(&words);
+    return failures_count == 0 ? 0 : 1;
+}
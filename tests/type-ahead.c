@@ -0,0 +1,105 @@
+#define _GNU_SOURCE // for posix_openpt, grantpt, unlockpt, ptsname
+
+#include "app.h"            // for TpvApp, TpvLine, tpv_read_line
+#include "prompt-queue.h"   // for Prompt
+#include "terminal-input.h" // for terminal_input_enable_raw, terminal_input_restore
+
+#include <fcntl.h>  // for open, O_RDWR, O_NOCTTY
+#include <stdio.h>  // for printf
+#include <stdlib.h> // for malloc, free, posix_openpt
+#include <time.h>   // for nanosleep
+#include <unistd.h> // for write, close
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+static bool type(int master_fd, const char* keys) {
+    for (const char* c = keys; *c != '\0'; ++c) {
+        if (write(master_fd, c, 1) != 1) return false;
+        sleep_ms(10);
+    }
+    return true;
+}
+
+static int failures_count = 0;
+
+// Keys typed before the line starts wait in the ring with their own, older stamps
+static void check_line(TpvApp* app, int master_fd, const char* keys, bool expect_positive, const char* what) {
+    if (!type(master_fd, keys)) {
+        printf("FAIL %s: could not type into the terminal\n", what);
+        failures_count++;
+        return;
+    }
+    sleep_ms(100);
+
+    Prompt prompt = { .text = SV("ab"), .render = SV("Type \"ab\"\n") };
+    TpvLine line = tpv_read_line(app, ">>> ", &prompt);
+    printf("\n");
+
+    bool in_range = expect_positive ? line.typing_time > 0.0 : line.typing_time >= 0.0;
+    if (line.interrupted || !in_range || line.typing_time > 1.0) {
+        printf("FAIL %s: typing time of %g seconds\n", what, line.typing_time);
+        failures_count++;
+    } else {
+        printf("ok   %s: %.3f seconds\n", what, line.typing_time);
+    }
+}
+
+// The time limit counts from the first key typed ahead too, not from when the line was read
+static void check_deadline(TpvApp* app, int master_fd, const char* what) {
+    app->args.time_limit.set = true;
+    app->args.time_limit.value = 0.2;
+    if (!type(master_fd, "a")) {
+        printf("FAIL %s: could not type into the terminal\n", what);
+        failures_count++;
+        return;
+    }
+    sleep_ms(150);
+
+    Prompt prompt = { .text = SV("ab"), .render = SV("Type \"ab\"\n") };
+    TpvLine line = tpv_read_line(app, ">>> ", &prompt);
+    printf("\n");
+    app->args.time_limit.set = false;
+
+    if (!line.timed_out || line.typing_time > 0.25) {
+        printf("FAIL %s: %s after %g seconds\n", what, line.timed_out ? "timed out" : "not timed out", line.typing_time);
+        failures_count++;
+    } else {
+        printf("ok   %s: %.3f seconds\n", what, line.typing_time);
+    }
+}
+
+int main(void) {
+    int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+        printf("skip no pseudo terminal available\n");
+        return 0;
+    }
+    int slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+    if (slave_fd < 0) {
+        printf("skip no pseudo terminal available\n");
+        return 0;
+    }
+
+    TpvApp app = {0};
+    app.line_cap = 64;
+    app.line_buf = malloc(app.line_cap);
+    app.key_events.events = malloc(KEY_EVENTS_CAPACITY * sizeof(KeyEvent));
+    if (!terminal_input_enable_raw(&app.terminal, slave_fd)) {
+        printf("FAIL could not switch the pseudo terminal to raw mode\n");
+        return 1;
+    }
+
+    check_line(&app, master_fd, "ab\r", true, "a whole line typed ahead");
+    check_line(&app, master_fd, "\r", false, "an Enter typed ahead");
+    check_deadline(&app, master_fd, "a time limit running from a key typed ahead");
+
+    terminal_input_restore(&app.terminal);
+    free(app.key_events.events);
+    free(app.line_buf);
+    close(slave_fd);
+    close(master_fd);
+    return failures_count == 0 ? 0 : 1;
+}